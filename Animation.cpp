@@ -0,0 +1,256 @@
+#include "Animation.hpp"
+
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANIMATION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//-------------------------
+//"smallest three" quaternion quantization:
+// the largest component (in absolute value) is dropped and recovered from the unit length constraint;
+// the others lie in [-1/sqrt(2), 1/sqrt(2)] and are stored in 15 bits each.
+// the dropped component's index is stored in the high bits of v[0] (bit 0) and v[1] (bit 1).
+
+static constexpr float QuatRange = 0.70710678f; //1/sqrt(2)
+
+Animation::QuantizedQuat Animation::QuantizedQuat::from(glm::quat const &q_) {
+	glm::quat q = glm::normalize(q_);
+	float c[4] = {q.x, q.y, q.z, q.w};
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+	}
+	//q and -q are the same rotation, so make the dropped component positive:
+	float sign = (c[largest] < 0.0f ? -1.0f : 1.0f);
+
+	QuantizedQuat ret;
+	uint32_t o = 0;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float u = (sign * c[i] / QuatRange) * 0.5f + 0.5f;
+		u = std::max(0.0f, std::min(1.0f, u));
+		ret.v[o++] = uint16_t(std::round(u * 32767.0f));
+	}
+	ret.v[0] |= uint16_t((largest & 1) << 15);
+	ret.v[1] |= uint16_t((largest >> 1) << 15);
+	return ret;
+}
+
+glm::quat Animation::QuantizedQuat::to_quat() const {
+	uint32_t largest = (v[0] >> 15) | ((v[1] >> 15) << 1);
+	float c[4];
+	float sum = 0.0f;
+	uint32_t o = 0;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		c[i] = ((v[o++] & 0x7fff) / 32767.0f * 2.0f - 1.0f) * QuatRange;
+		sum += c[i] * c[i];
+	}
+	c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+	return glm::quat(c[3], c[0], c[1], c[2]); //n.b. wxyz init order
+}
+
+//-------------------------
+
+Animation::Animation(std::string const &filename) {
+	MappedFile file(filename);
+	char const *at = file.data;
+	char const *end = file.data + file.size;
+
+	ChunkView< char > names;
+	read_chunk(&at, end, "str0", &names);
+	std::string_view interned_names = Scene::intern(std::string_view(names.data(), names.size()));
+
+	ChunkView< float > loaded_times;
+	read_chunk(&at, end, "tim0", &loaded_times);
+
+	struct TrackEntry {
+		uint32_t name_begin, name_end;
+		uint32_t channel; //0: position, 1: rotation
+		uint32_t times_begin, times_end;
+		uint32_t values_begin;
+	};
+	static_assert(sizeof(TrackEntry) == 6 * 4, "TrackEntry is packed.");
+	ChunkView< TrackEntry > loaded_tracks;
+	read_chunk(&at, end, "trk0", &loaded_tracks);
+
+	ChunkView< glm::vec3 > loaded_positions;
+	read_chunk(&at, end, "pos0", &loaded_positions);
+
+	ChunkView< QuantizedQuat > loaded_rotations;
+	read_chunk(&at, end, "rot0", &loaded_rotations);
+
+	if (at != end) {
+		std::cerr << "WARNING: trailing data in animation file '" << filename << "'" << std::endl;
+	}
+
+	times.assign(loaded_times.begin(), loaded_times.end());
+	positions.assign(loaded_positions.begin(), loaded_positions.end());
+	rotations.assign(loaded_rotations.begin(), loaded_rotations.end());
+
+	for (auto const &t : loaded_times) {
+		duration = std::max(duration, t);
+	}
+
+	tracks.reserve(loaded_tracks.size());
+	for (auto const &entry : loaded_tracks) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= names.size())) {
+			throw std::runtime_error("animation file '" + filename + "' contains track with invalid name indices");
+		}
+		if (!(entry.times_begin < entry.times_end && entry.times_end <= times.size())) {
+			throw std::runtime_error("animation file '" + filename + "' contains track with invalid time range");
+		}
+		size_t values = (entry.channel == Track::Position ? positions.size() : rotations.size());
+		if (entry.channel > Track::Rotation || entry.values_begin + size_t(entry.times_end - entry.times_begin) > values) {
+			throw std::runtime_error("animation file '" + filename + "' contains track with invalid channel or values");
+		}
+		tracks.emplace_back();
+		Track &track = tracks.back();
+		track.name = interned_names.substr(entry.name_begin, entry.name_end - entry.name_begin);
+		track.channel = Track::Channel(entry.channel);
+		track.times_begin = entry.times_begin;
+		track.times_end = entry.times_end;
+		track.values_begin = entry.values_begin;
+	}
+}
+
+//-------------------------
+
+AnimationPlayer::AnimationPlayer(Animation const &animation_, Scene &scene, float speed_, bool loop_) : animation(animation_), speed(speed_), loop(loop_) {
+	for (auto const &track : animation.tracks) {
+		Scene::Transform *transform = scene.find_transform(track.name);
+		if (!transform) continue;
+		if (track.channel == Animation::Track::Position) position_tracks.emplace_back(Bound{transform, &track});
+		else rotation_tracks.emplace_back(Bound{transform, &track});
+	}
+	auto by_times = [](Bound const &a, Bound const &b) {
+		if (a.track->times_begin != b.track->times_begin) return a.track->times_begin < b.track->times_begin;
+		return a.track->times_end < b.track->times_end;
+	};
+	std::stable_sort(position_tracks.begin(), position_tracks.end(), by_times);
+	std::stable_sort(rotation_tracks.begin(), rotation_tracks.end(), by_times);
+}
+
+void AnimationPlayer::advance(float elapsed) {
+	time += speed * elapsed;
+	if (loop && animation.duration > 0.0f) {
+		time -= std::floor(time / animation.duration) * animation.duration;
+	} else {
+		time = std::max(0.0f, std::min(animation.duration, time));
+	}
+}
+
+void AnimationPlayer::find_spans(std::vector< Bound > const &bound, std::vector< Span > *spans_) const {
+	auto &out = *spans_;
+	out.clear();
+	out.reserve(bound.size());
+
+	uint32_t last_begin = -1U, last_end = -1U;
+	uint32_t key = 0; //offset of the earlier key within the time range
+	uint32_t next = 0; //offset of the later key
+	float t = 0.0f;
+	for (auto const &b : bound) {
+		Animation::Track const &track = *b.track;
+		//tracks are sorted by time range, so each shared range is only searched once:
+		if (track.times_begin != last_begin || track.times_end != last_end) {
+			last_begin = track.times_begin;
+			last_end = track.times_end;
+			float const *begin = animation.times.data() + track.times_begin;
+			float const *end = animation.times.data() + track.times_end;
+			float const *after = std::upper_bound(begin, end, time);
+			if (after == begin) {
+				key = next = 0;
+				t = 0.0f;
+			} else if (after == end) {
+				key = next = uint32_t(end - begin) - 1;
+				t = 0.0f;
+			} else {
+				next = uint32_t(after - begin);
+				key = next - 1;
+				float span = begin[next] - begin[key];
+				t = (span > 0.0f ? (time - begin[key]) / span : 0.0f);
+			}
+		}
+		out.emplace_back(Span{track.values_begin + key, track.values_begin + next, t});
+	}
+}
+
+void AnimationPlayer::apply() {
+	//positions (plain lerp):
+	find_spans(position_tracks, &spans);
+	for (size_t i = 0; i < position_tracks.size(); ++i) {
+		Span const &s = spans[i];
+		position_tracks[i].transform->position = glm::mix(animation.positions[s.a], animation.positions[s.b], s.t);
+	}
+
+	//rotations (normalized lerp along the shorter arc), decoded into structure-of-arrays form and blended four at a time:
+	find_spans(rotation_tracks, &spans);
+	size_t count = rotation_tracks.size();
+	size_t padded = (count + 3) & ~size_t(3);
+	soa.assign(padded * 9, 0.0f);
+	float *ax = soa.data() + 0 * padded, *ay = soa.data() + 1 * padded, *az = soa.data() + 2 * padded, *aw = soa.data() + 3 * padded;
+	float *bx = soa.data() + 4 * padded, *by = soa.data() + 5 * padded, *bz = soa.data() + 6 * padded, *bw = soa.data() + 7 * padded;
+	float *ts = soa.data() + 8 * padded;
+	for (size_t i = 0; i < count; ++i) {
+		Span const &s = spans[i];
+		glm::quat a = animation.rotations[s.a].to_quat();
+		glm::quat b = animation.rotations[s.b].to_quat();
+		ax[i] = a.x; ay[i] = a.y; az[i] = a.z; aw[i] = a.w;
+		bx[i] = b.x; by[i] = b.y; bz[i] = b.z; bw[i] = b.w;
+		ts[i] = s.t;
+	}
+	//(padding lanes blend identity with identity, so they normalize safely)
+	for (size_t i = count; i < padded; ++i) {
+		aw[i] = bw[i] = 1.0f;
+	}
+
+	//results overwrite the 'a' arrays:
+#ifdef ANIMATION_SSE2
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const sign_bit = _mm_set1_ps(-0.0f);
+	for (size_t i = 0; i < padded; i += 4) {
+		__m128 qax = _mm_loadu_ps(ax + i), qay = _mm_loadu_ps(ay + i), qaz = _mm_loadu_ps(az + i), qaw = _mm_loadu_ps(aw + i);
+		__m128 qbx = _mm_loadu_ps(bx + i), qby = _mm_loadu_ps(by + i), qbz = _mm_loadu_ps(bz + i), qbw = _mm_loadu_ps(bw + i);
+		__m128 t = _mm_loadu_ps(ts + i);
+
+		//flip b onto a's hemisphere where dot(a,b) < 0:
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qax, qbx), _mm_mul_ps(qay, qby)), _mm_add_ps(_mm_mul_ps(qaz, qbz), _mm_mul_ps(qaw, qbw)));
+		__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, zero), sign_bit);
+		qbx = _mm_xor_ps(qbx, flip); qby = _mm_xor_ps(qby, flip); qbz = _mm_xor_ps(qbz, flip); qbw = _mm_xor_ps(qbw, flip);
+
+		__m128 qx = _mm_add_ps(qax, _mm_mul_ps(_mm_sub_ps(qbx, qax), t));
+		__m128 qy = _mm_add_ps(qay, _mm_mul_ps(_mm_sub_ps(qby, qay), t));
+		__m128 qz = _mm_add_ps(qaz, _mm_mul_ps(_mm_sub_ps(qbz, qaz), t));
+		__m128 qw = _mm_add_ps(qaw, _mm_mul_ps(_mm_sub_ps(qbw, qaw), t));
+
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw))));
+		_mm_storeu_ps(ax + i, _mm_div_ps(qx, len));
+		_mm_storeu_ps(ay + i, _mm_div_ps(qy, len));
+		_mm_storeu_ps(az + i, _mm_div_ps(qz, len));
+		_mm_storeu_ps(aw + i, _mm_div_ps(qw, len));
+	}
+#else
+	for (size_t i = 0; i < padded; ++i) {
+		float dot = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i] + aw[i] * bw[i];
+		float s = (dot < 0.0f ? -1.0f : 1.0f);
+		float qx = ax[i] + (s * bx[i] - ax[i]) * ts[i];
+		float qy = ay[i] + (s * by[i] - ay[i]) * ts[i];
+		float qz = az[i] + (s * bz[i] - az[i]) * ts[i];
+		float qw = aw[i] + (s * bw[i] - aw[i]) * ts[i];
+		float len = std::sqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+		ax[i] = qx / len; ay[i] = qy / len; az[i] = qz / len; aw[i] = qw / len;
+	}
+#endif
+
+	for (size_t i = 0; i < count; ++i) {
+		rotation_tracks[i].transform->rotation = glm::quat(aw[i], ax[i], ay[i], az[i]); //n.b. wxyz init order
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+ * An Animation is a set of keyframe tracks that move named transforms.
+ *
+ * Storage is compact: tracks that were sampled at the same moments share
+ *  one range of 'times', and rotations are stored as "smallest three"
+ *  quantized quaternions (three 15-bit components plus a 2-bit index of
+ *  the dropped, largest component -- six bytes per key).
+ *
+ * Animations are loaded from '.anim' files, written by export-scene.py next
+ *  to the '.scene' file they animate:
+ *   str0 < char > * [strings chunk]
+ *   tim0 < float > * [key times, in seconds; shared by tracks]
+ *   trk0 < TrackEntry > * [tracks; see Animation.cpp]
+ *   pos0 < float3 > * [position keys]
+ *   rot0 < uint16 x3 > * [quantized rotation keys]
+ *
+ * An AnimationPlayer binds an animation's tracks to a scene's transforms and
+ *  samples all of them in one batched pass (SIMD when available), writing
+ *  straight into Transform::position and Transform::rotation.
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+struct Animation {
+	//empty animation (fill in the members below yourself):
+	Animation() = default;
+	//load from an '.anim' file:
+	// note: throws on file format errors
+	Animation(std::string const &filename);
+
+	struct QuantizedQuat {
+		uint16_t v[3] = {0, 0, 0};
+
+		static QuantizedQuat from(glm::quat const &q);
+		glm::quat to_quat() const;
+	};
+	static_assert(sizeof(QuantizedQuat) == 6, "QuantizedQuat is packed.");
+
+	struct Track {
+		std::string_view name; //name of the transform this track moves (interned)
+		enum Channel : uint32_t {
+			Position = 0,
+			Rotation = 1,
+		} channel = Rotation;
+		uint32_t times_begin = 0, times_end = 0; //range in 'times' (non-empty, increasing)
+		uint32_t values_begin = 0; //first value in 'positions' or 'rotations' (one value per time)
+	};
+
+	std::vector< float > times;
+	std::vector< glm::vec3 > positions;
+	std::vector< QuantizedQuat > rotations;
+	std::vector< Track > tracks;
+
+	float duration = 0.0f; //length of the animation (the latest key time)
+};
+
+struct AnimationPlayer {
+	//bind 'animation' to the transforms of 'scene' with matching names (tracks for missing transforms are ignored):
+	// (both must outlive the player)
+	AnimationPlayer(Animation const &animation, Scene &scene, float speed = 1.0f, bool loop = true);
+
+	Animation const &animation;
+	float time = 0.0f; //current time, in seconds
+	float speed = 1.0f; //time advances by speed * elapsed
+	bool loop = true; //wrap around at the end of the animation? (otherwise, stop there)
+
+	//advance time:
+	void advance(float elapsed);
+
+	//sample every bound track at 'time' and write the results to the transforms:
+	void apply();
+
+	//-- internals ---
+
+	//tracks bound to transforms, sorted by time range so that each shared range is searched once per apply():
+	struct Bound {
+		Scene::Transform *transform;
+		Animation::Track const *track;
+	};
+	std::vector< Bound > position_tracks;
+	std::vector< Bound > rotation_tracks;
+
+	//key pair + blend factor for one track:
+	struct Span {
+		uint32_t a, b; //value indices
+		float t; //blend from a to b
+	};
+	void find_spans(std::vector< Bound > const &bound, std::vector< Span > *spans) const;
+
+	//scratch space for batched sampling (structure-of-arrays, padded to a multiple of four):
+	std::vector< Span > spans;
+	std::vector< float > soa;
+};
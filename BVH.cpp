@@ -0,0 +1,222 @@
+#include "BVH.hpp"
+
+//Tree maintenance follows the usual "dynamic AABB tree" approach
+// (as in, e.g., Box2D's b2DynamicTree): leaves are inserted next to the
+// sibling that minimizes the growth in surface area, and AVL-style
+// rotations keep the tree height logarithmic.
+
+BVH::AABB BVH::AABB::transformed(glm::mat4x3 const &xf) const {
+	if (empty()) return AABB();
+	//transform the center, then grow the extent by the absolute value of the linear part:
+	glm::vec3 center = 0.5f * (min + max);
+	glm::vec3 extent = 0.5f * (max - min);
+	glm::vec3 new_center = xf * glm::vec4(center, 1.0f);
+	glm::vec3 new_extent =
+		  glm::abs(xf[0]) * extent.x
+		+ glm::abs(xf[1]) * extent.y
+		+ glm::abs(xf[2]) * extent.z;
+	return AABB(new_center - new_extent, new_center + new_extent);
+}
+
+//-------------------------
+
+uint32_t BVH::allocate_node() {
+	if (free_list == -1U) {
+		nodes.emplace_back();
+		return uint32_t(nodes.size() - 1);
+	}
+	uint32_t node = free_list;
+	free_list = nodes[node].parent;
+	nodes[node] = Node();
+	return node;
+}
+
+void BVH::free_node(uint32_t node) {
+	assert(node < nodes.size());
+	nodes[node].parent = free_list;
+	nodes[node].height = -1;
+	nodes[node].data = nullptr;
+	free_list = node;
+}
+
+uint32_t BVH::insert(AABB const &box, void *data) {
+	assert(!box.empty());
+	uint32_t leaf = allocate_node();
+	glm::vec3 grow = margin * (box.max - box.min) + glm::vec3(1e-4f);
+	nodes[leaf].box = AABB(box.min - grow, box.max + grow);
+	nodes[leaf].data = data;
+	nodes[leaf].height = 0;
+	insert_leaf(leaf);
+	return leaf;
+}
+
+void BVH::remove(uint32_t leaf) {
+	assert(leaf < nodes.size() && nodes[leaf].is_leaf() && nodes[leaf].height == 0);
+	remove_leaf(leaf);
+	free_node(leaf);
+}
+
+bool BVH::move(uint32_t leaf, AABB const &box) {
+	assert(leaf < nodes.size() && nodes[leaf].is_leaf() && nodes[leaf].height == 0);
+	assert(!box.empty());
+	if (nodes[leaf].box.contains(box)) return false;
+
+	remove_leaf(leaf);
+	glm::vec3 grow = margin * (box.max - box.min) + glm::vec3(1e-4f);
+	nodes[leaf].box = AABB(box.min - grow, box.max + grow);
+	insert_leaf(leaf);
+	return true;
+}
+
+void BVH::clear() {
+	nodes.clear();
+	root = -1U;
+	free_list = -1U;
+}
+
+//-------------------------
+
+void BVH::insert_leaf(uint32_t leaf) {
+	if (root == -1U) {
+		root = leaf;
+		nodes[root].parent = -1U;
+		return;
+	}
+
+	//walk down the tree, choosing the child that makes the cheapest sibling:
+	AABB const leaf_box = nodes[leaf].box;
+	uint32_t index = root;
+	while (!nodes[index].is_leaf()) {
+		Node const &node = nodes[index];
+		float area = node.box.half_area();
+		float combined_area = AABB::merge(node.box, leaf_box).half_area();
+
+		//cost of making a new parent for this node and the leaf:
+		float cost = 2.0f * combined_area;
+		//minimum cost of pushing the leaf further down the tree:
+		float inheritance_cost = 2.0f * (combined_area - area);
+
+		auto descend_cost = [&](uint32_t child) {
+			Node const &c = nodes[child];
+			float merged = AABB::merge(c.box, leaf_box).half_area();
+			if (c.is_leaf()) return merged + inheritance_cost;
+			else return (merged - c.box.half_area()) + inheritance_cost;
+		};
+		float cost0 = descend_cost(node.child[0]);
+		float cost1 = descend_cost(node.child[1]);
+
+		if (cost < cost0 && cost < cost1) break;
+		index = (cost0 < cost1 ? node.child[0] : node.child[1]);
+	}
+	uint32_t sibling = index;
+
+	//make a new parent for sibling + leaf:
+	uint32_t old_parent = nodes[sibling].parent;
+	uint32_t new_parent = allocate_node(); //n.b. may reallocate 'nodes'
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].box = AABB::merge(leaf_box, nodes[sibling].box);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].child[0] = sibling;
+	nodes[new_parent].child[1] = leaf;
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	if (old_parent == -1U) {
+		root = new_parent;
+	} else {
+		if (nodes[old_parent].child[0] == sibling) nodes[old_parent].child[0] = new_parent;
+		else nodes[old_parent].child[1] = new_parent;
+	}
+
+	//walk back up, refitting boxes and rebalancing:
+	index = nodes[leaf].parent;
+	while (index != -1U) {
+		index = balance(index);
+		Node &node = nodes[index];
+		node.height = 1 + std::max(nodes[node.child[0]].height, nodes[node.child[1]].height);
+		node.box = AABB::merge(nodes[node.child[0]].box, nodes[node.child[1]].box);
+		index = node.parent;
+	}
+}
+
+void BVH::remove_leaf(uint32_t leaf) {
+	if (leaf == root) {
+		root = -1U;
+		return;
+	}
+
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grand_parent = nodes[parent].parent;
+	uint32_t sibling = (nodes[parent].child[0] == leaf ? nodes[parent].child[1] : nodes[parent].child[0]);
+
+	if (grand_parent == -1U) {
+		root = sibling;
+		nodes[sibling].parent = -1U;
+		free_node(parent);
+		return;
+	}
+
+	//splice sibling into parent's place:
+	if (nodes[grand_parent].child[0] == parent) nodes[grand_parent].child[0] = sibling;
+	else nodes[grand_parent].child[1] = sibling;
+	nodes[sibling].parent = grand_parent;
+	free_node(parent);
+
+	//refit ancestors:
+	uint32_t index = grand_parent;
+	while (index != -1U) {
+		index = balance(index);
+		Node &node = nodes[index];
+		node.height = 1 + std::max(nodes[node.child[0]].height, nodes[node.child[1]].height);
+		node.box = AABB::merge(nodes[node.child[0]].box, nodes[node.child[1]].box);
+		index = node.parent;
+	}
+}
+
+//rotate the subtree rooted at 'a' if it is out of balance; returns the new subtree root:
+uint32_t BVH::balance(uint32_t a) {
+	assert(a != -1U);
+	Node &A = nodes[a];
+	if (A.is_leaf() || A.height < 2) return a;
+
+	uint32_t b = A.child[0];
+	uint32_t c = A.child[1];
+	int32_t balance_factor = nodes[c].height - nodes[b].height;
+
+	//promote whichever child is taller by two or more:
+	auto rotate = [&](uint32_t up, uint32_t other) -> uint32_t {
+		Node &U = nodes[up];
+		uint32_t f = U.child[0];
+		uint32_t g = U.child[1];
+
+		//swap 'a' and 'up':
+		U.child[0] = a;
+		U.parent = A.parent;
+		A.parent = up;
+
+		if (U.parent != -1U) {
+			if (nodes[U.parent].child[0] == a) nodes[U.parent].child[0] = up;
+			else nodes[U.parent].child[1] = up;
+		} else {
+			root = up;
+		}
+
+		//keep the taller of up's children in 'up', hand the other to 'a':
+		uint32_t keep = f, give = g;
+		if (nodes[f].height < nodes[g].height) std::swap(keep, give);
+		U.child[1] = keep;
+		if (A.child[0] == up) A.child[0] = give;
+		else A.child[1] = give;
+		nodes[give].parent = a;
+
+		A.box = AABB::merge(nodes[other].box, nodes[give].box);
+		U.box = AABB::merge(A.box, nodes[keep].box);
+		A.height = 1 + std::max(nodes[other].height, nodes[give].height);
+		U.height = 1 + std::max(A.height, nodes[keep].height);
+		return up;
+	};
+
+	if (balance_factor > 1) return rotate(c, b);
+	if (balance_factor < -1) return rotate(b, c);
+	return a;
+}
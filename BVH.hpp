@@ -0,0 +1,222 @@
+#pragma once
+
+/*
+ * A BVH is a dynamic bounding volume hierarchy over axis-aligned boxes.
+ *
+ * Each leaf stores a user pointer and a "fat" box (the item's box grown by
+ *  a margin) so that small motions can be absorbed by move() without
+ *  touching the tree. Internal nodes are kept balanced with rotations.
+ *
+ * Queries (box overlap, view frustum, ray) walk the tree with an explicit
+ *  stack and call a callback for every leaf they reach.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cassert>
+
+struct BVH {
+	struct AABB {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		AABB() = default;
+		AABB(glm::vec3 const &min_, glm::vec3 const &max_) : min(min_), max(max_) { }
+
+		bool empty() const { return !(min.x <= max.x && min.y <= max.y && min.z <= max.z); }
+		bool contains(AABB const &o) const {
+			return min.x <= o.min.x && min.y <= o.min.y && min.z <= o.min.z
+			    && o.max.x <= max.x && o.max.y <= max.y && o.max.z <= max.z;
+		}
+		bool overlaps(AABB const &o) const {
+			return min.x <= o.max.x && o.min.x <= max.x
+			    && min.y <= o.max.y && o.min.y <= max.y
+			    && min.z <= o.max.z && o.min.z <= max.z;
+		}
+		//half the surface area; used as the insertion cost metric:
+		float half_area() const {
+			glm::vec3 d = max - min;
+			return d.x * d.y + d.y * d.z + d.z * d.x;
+		}
+		static AABB merge(AABB const &a, AABB const &b) {
+			return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+		}
+		//box (in world space) containing this box transformed by 'xf':
+		AABB transformed(glm::mat4x3 const &xf) const;
+		//slab test against ray origin + t * direction, t in [0,t_max]; returns entry 't' or infinity on a miss:
+		// (takes 1/direction, which the caller usually computes once per ray)
+		float ray_hit(glm::vec3 const &origin, glm::vec3 const &inv_direction, float t_max) const {
+			glm::vec3 t0 = (min - origin) * inv_direction;
+			glm::vec3 t1 = (max - origin) * inv_direction;
+			glm::vec3 lo = glm::min(t0, t1);
+			glm::vec3 hi = glm::max(t0, t1);
+			float enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+			float exit = std::min(std::min(hi.x, hi.y), std::min(hi.z, t_max));
+			if (enter <= exit) return enter;
+			else return std::numeric_limits< float >::infinity();
+		}
+	};
+
+	//add an item; returns a leaf id that stays valid until remove():
+	uint32_t insert(AABB const &box, void *data);
+	//remove an item by leaf id:
+	void remove(uint32_t leaf);
+	//update an item's box; returns true if the leaf had to be re-inserted
+	// (that is, 'box' escaped the leaf's fat box):
+	bool move(uint32_t leaf, AABB const &box);
+	//remove all items:
+	void clear();
+
+	bool empty() const { return root == -1U; }
+	void *get_data(uint32_t leaf) const { assert(leaf < nodes.size() && nodes[leaf].is_leaf()); return nodes[leaf].data; }
+	AABB const &get_fat_box(uint32_t leaf) const { assert(leaf < nodes.size() && nodes[leaf].is_leaf()); return nodes[leaf].box; }
+
+	//call callback(void *data) for every leaf whose fat box overlaps 'box':
+	// (callback returns 'false' to stop the query early)
+	template< typename F >
+	void query_box(AABB const &box, F const &callback) const;
+
+	//call callback(void *data) for every leaf whose fat box is at least partly
+	// inside the view frustum given by 'world_to_clip':
+	template< typename F >
+	void query_frustum(glm::mat4 const &world_to_clip, F const &callback) const;
+
+	//call callback(void *data, float t) for every leaf whose fat box is hit by
+	// the ray origin + t * direction for t in [0, t_max], where 't' is the entry point:
+	// (callback returns the new t_max, e.g. to clip the ray to the nearest hit found so far)
+	template< typename F >
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, F const &callback) const;
+
+	//fat boxes are grown by this fraction of their size (plus a tiny absolute amount) on each side:
+	float margin = 0.1f;
+
+	//-- internals ---
+
+	struct Node {
+		AABB box; //for leaves, the fat box
+		uint32_t parent = -1U; //(also used as 'next' pointer in the free list)
+		uint32_t child[2] = {-1U, -1U};
+		int32_t height = 0; //leaves have height 0; free nodes have height -1
+		void *data = nullptr;
+		bool is_leaf() const { return child[0] == -1U; }
+	};
+	std::vector< Node > nodes;
+	uint32_t root = -1U;
+	uint32_t free_list = -1U;
+
+	uint32_t allocate_node();
+	void free_node(uint32_t node);
+	void insert_leaf(uint32_t leaf);
+	void remove_leaf(uint32_t leaf);
+	uint32_t balance(uint32_t node);
+};
+
+//-------------------------
+//query implementations (templated so the callbacks inline):
+
+template< typename F >
+void BVH::query_box(AABB const &box, F const &callback) const {
+	if (root == -1U) return;
+	uint32_t stack[64];
+	uint32_t top = 0;
+	stack[top++] = root;
+	while (top) {
+		Node const &node = nodes[stack[--top]];
+		if (!node.box.overlaps(box)) continue;
+		if (node.is_leaf()) {
+			if (!callback(node.data)) return;
+		} else {
+			assert(top + 2 <= 64 && "tree is balanced, so depth should be small");
+			stack[top++] = node.child[0];
+			stack[top++] = node.child[1];
+		}
+	}
+}
+
+template< typename F >
+void BVH::query_frustum(glm::mat4 const &world_to_clip, F const &callback) const {
+	if (root == -1U) return;
+
+	//extract the six frustum planes (a point p is inside when dot(plane, vec4(p,1)) >= 0):
+	glm::mat4 const &m = world_to_clip;
+	glm::vec4 row[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+	}
+	glm::vec4 planes[6] = {
+		row[3] + row[0], row[3] - row[0], //left, right
+		row[3] + row[1], row[3] - row[1], //bottom, top
+		row[3] + row[2], row[3] - row[2], //near, far (far is all-pass for infinite projections)
+	};
+
+	//each stack entry remembers which planes still need testing,
+	// so subtrees entirely inside the frustum are not re-tested:
+	struct Entry { uint32_t node; uint32_t mask; };
+	Entry stack[64];
+	uint32_t top = 0;
+	stack[top++] = Entry{root, 0x3f};
+	while (top) {
+		Entry entry = stack[--top];
+		Node const &node = nodes[entry.node];
+		uint32_t mask = entry.mask;
+		bool outside = false;
+		for (uint32_t p = 0; p < 6; ++p) {
+			if (!(mask & (1 << p))) continue;
+			glm::vec4 const &pl = planes[p];
+			//farthest corner along the plane normal:
+			glm::vec3 p_vertex = glm::vec3(
+				(pl.x >= 0.0f ? node.box.max.x : node.box.min.x),
+				(pl.y >= 0.0f ? node.box.max.y : node.box.min.y),
+				(pl.z >= 0.0f ? node.box.max.z : node.box.min.z)
+			);
+			if (glm::dot(glm::vec3(pl), p_vertex) + pl.w < 0.0f) {
+				outside = true;
+				break;
+			}
+			//nearest corner along the plane normal; if it's inside, the whole box is:
+			glm::vec3 n_vertex = glm::vec3(
+				(pl.x >= 0.0f ? node.box.min.x : node.box.max.x),
+				(pl.y >= 0.0f ? node.box.min.y : node.box.max.y),
+				(pl.z >= 0.0f ? node.box.min.z : node.box.max.z)
+			);
+			if (glm::dot(glm::vec3(pl), n_vertex) + pl.w >= 0.0f) {
+				mask &= ~(1 << p);
+			}
+		}
+		if (outside) continue;
+		if (node.is_leaf()) {
+			if (!callback(node.data)) return;
+		} else {
+			assert(top + 2 <= 64 && "tree is balanced, so depth should be small");
+			stack[top++] = Entry{node.child[0], mask};
+			stack[top++] = Entry{node.child[1], mask};
+		}
+	}
+}
+
+template< typename F >
+void BVH::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, F const &callback) const {
+	if (root == -1U) return;
+	glm::vec3 inv_dir = glm::vec3(1.0f) / direction; //n.b. infinities for axis-aligned rays are fine in the slab test
+
+	uint32_t stack[64];
+	uint32_t top = 0;
+	stack[top++] = root;
+	while (top) {
+		Node const &node = nodes[stack[--top]];
+		float t = node.box.ray_hit(origin, inv_dir, t_max);
+		if (t > t_max) continue;
+		if (node.is_leaf()) {
+			t_max = callback(node.data, t);
+		} else {
+			assert(top + 2 <= 64 && "tree is balanced, so depth should be small");
+			stack[top++] = node.child[0];
+			stack[top++] = node.child[1];
+		}
+	}
+}
@@ -4,6 +4,7 @@
 #include "freetype/freetype.h"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "RenderStats.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -124,6 +125,8 @@ void CustomText::draw_text(const char* intext, glm::vec2 position, float scale,
 	glUseProgram(textProgram);
 	glActiveTexture(GL_TEXTURE0);
     glBindVertexArray(VAO);
+	render_stats.current.program_binds += 1;
+	render_stats.current.vao_binds += 1;
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	std::string fullText = intext;
@@ -190,6 +193,10 @@ void CustomText::draw_text(const char* intext, glm::vec2 position, float scale,
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         // render quad
         glDrawArrays(GL_TRIANGLES, 0, 6);
+		render_stats.current.texture_binds += 1;
+		render_stats.current.bytes_uploaded += sizeof(vertices);
+		render_stats.current.draw_calls += 1;
+		render_stats.current.vertices += 6;
         // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
 		x += (float)(pos[i].x_advance / 64.);
 		y += (float)(pos[i].y_advance / 64.);
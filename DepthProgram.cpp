@@ -0,0 +1,48 @@
+#include "DepthProgram.hpp"
+
+#include "Scene.hpp"
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+Load< DepthProgram > depth_program(LoadTagEarly);
+
+DepthProgram::DepthProgram() {
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		// (n.b. gl_Position must be computed exactly as in the color pass's programs, since that pass tests with GL_EQUAL)
+		"#version 330\n"
+		"uniform samplerBuffer OBJECT_MATRICES;\n"
+		"uniform int DRAW_BASE;\n"
+		"layout(location = 0) in vec4 Position;\n"
+		"layout(location = 1) in float PaletteIndex;\n"
+		"invariant gl_Position;\n"
+		"void main() {\n"
+		"	int base = 10 * (DRAW_BASE + gl_InstanceID + int(PaletteIndex));\n"
+		"	mat4 OBJECT_TO_CLIP = mat4(\n"
+		"		texelFetch(OBJECT_MATRICES, base+0), texelFetch(OBJECT_MATRICES, base+1),\n"
+		"		texelFetch(OBJECT_MATRICES, base+2), texelFetch(OBJECT_MATRICES, base+3));\n"
+		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"void main() {\n"
+		"}\n"
+	);
+
+	//look up the locations of uniforms:
+	DRAW_BASE_int = glGetUniformLocation(program, "DRAW_BASE");
+	GLuint OBJECT_MATRICES_samplerBuffer = glGetUniformLocation(program, "OBJECT_MATRICES");
+
+	glUseProgram(program);
+	glUniform1i(OBJECT_MATRICES_samplerBuffer, Scene::ObjectMatricesTextureUnit); //set OBJECT_MATRICES to sample from where Scene::draw binds it
+	glUseProgram(0);
+
+	GL_ERRORS();
+}
+
+DepthProgram::~DepthProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+
+//Shader program that only writes depth; used by Scene::DrawList::submit for the depth pre-pass:
+// reads matrices from the object matrix buffer (see Scene::ObjectMatrices) and positions from
+// attribute location PositionLocation (and, for merged models, PaletteIndexLocation; see PaletteBatch.hpp),
+// so vertex arrays built for any program that declares "layout(location = 0) in vec4 Position;" work with it.
+struct DepthProgram {
+	DepthProgram();
+	~DepthProgram();
+
+	GLuint program = 0;
+	//Attribute (per-vertex variable) locations:
+	enum : GLuint { PositionLocation = 0, PaletteIndexLocation = 1 };
+	//Uniform (per-invocation variable) locations:
+	GLuint DRAW_BASE_int = -1U;
+	//Textures:
+	// TEXTURE<Scene::ObjectMatricesTextureUnit> - object matrices
+};
+
+extern Load< DepthProgram > depth_program;
@@ -1,6 +1,7 @@
 #include "DrawLines.hpp"
 #include "PathFont.hpp"
 #include "ColorProgram.hpp"
+#include "RenderStats.hpp"
 
 #include "gl_errors.hpp"
 
@@ -141,18 +142,23 @@ DrawLines::~DrawLines() {
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
 	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	render_stats.current.bytes_uploaded += attribs.size() * sizeof(attribs[0]);
 
 	//set color_program as current program:
 	glUseProgram(color_program->program);
+	render_stats.current.program_binds += 1;
 
 	//upload OBJECT_TO_CLIP to the proper uniform location:
 	glUniformMatrix4fv(color_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
 
 	//use the mapping vertex_buffer_for_color_program to fetch vertex data:
 	glBindVertexArray(vertex_buffer_for_color_program);
+	render_stats.current.vao_binds += 1;
 
 	//run the OpenGL pipeline:
 	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
+	render_stats.current.draw_calls += 1;
+	render_stats.current.vertices += attribs.size();
 
 	//reset vertex array to none:
 	glBindVertexArray(0);
@@ -0,0 +1,46 @@
+#include "GPUTimer.hpp"
+
+#include "gl_errors.hpp"
+
+#include <cassert>
+
+GPUTimer::GPUTimer() {
+	glGenQueries(QueryCount, queries);
+	GL_ERRORS();
+}
+
+GPUTimer::~GPUTimer() {
+	if (running) glEndQuery(GL_TIME_ELAPSED);
+	glDeleteQueries(QueryCount, queries);
+}
+
+void GPUTimer::begin() {
+	assert(!running && "GPUTimer::begin() called twice without end()");
+	poll();
+	if (in_flight == QueryCount) return; //no free query; skip this measurement
+	glBeginQuery(GL_TIME_ELAPSED, queries[(oldest + in_flight) % QueryCount]);
+	running = true;
+}
+
+void GPUTimer::end() {
+	if (!running) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	running = false;
+	in_flight += 1;
+}
+
+void GPUTimer::poll() {
+	while (in_flight > 0) {
+		GLuint query = queries[oldest];
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		milliseconds = float(double(nanoseconds) * 1e-6);
+
+		oldest = (oldest + 1) % QueryCount;
+		in_flight -= 1;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * A GPUTimer measures how long the GPU spends on the commands issued
+ *  between begin() and end(), using GL_TIME_ELAPSED queries.
+ *
+ * Results arrive a few frames late; the timer keeps a small ring of queries
+ *  and never waits for one, so reading results doesn't stall the pipeline.
+ *  (If every query is still in flight, that frame simply isn't measured.)
+ *
+ * Only one GL_TIME_ELAPSED query may be active at a time, so timers can't nest.
+ *
+ */
+
+#include "GL.hpp"
+
+#include <cstdint>
+
+struct GPUTimer {
+	GPUTimer();
+	~GPUTimer();
+
+	GPUTimer(GPUTimer const &) = delete;
+	GPUTimer &operator=(GPUTimer const &) = delete;
+
+	void begin();
+	void end();
+
+	//most recent finished measurement, in milliseconds (negative until one is available):
+	float milliseconds = -1.0f;
+
+	//-- internals ---
+	enum : uint32_t { QueryCount = 4 };
+	GLuint queries[QueryCount] = {0, 0, 0, 0};
+	uint32_t oldest = 0; //oldest query still in flight
+	uint32_t in_flight = 0; //number of queries ended but not yet read
+	bool running = false; //between begin() and end() with a query active
+
+	//read back any finished queries (oldest first):
+	void poll();
+};
@@ -0,0 +1,206 @@
+#include "LightClusters.hpp"
+
+#include "gl_errors.hpp"
+#include "RenderStats.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+LightClusters::LightClusters() {
+	auto make = [](GLuint *buffer, GLuint *texture, GLenum format) {
+		glGenBuffers(1, buffer);
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_BUFFER, *texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, *buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	};
+	make(&lights_buffer, &lights_texture, GL_RGBA32F);
+	make(&clusters_buffer, &clusters_texture, GL_RG32UI);
+	make(&light_indices_buffer, &light_indices_texture, GL_R32UI);
+
+	GL_ERRORS();
+}
+
+LightClusters::~LightClusters() {
+	glDeleteTextures(1, &lights_texture);
+	glDeleteTextures(1, &clusters_texture);
+	glDeleteTextures(1, &light_indices_texture);
+	glDeleteBuffers(1, &lights_buffer);
+	glDeleteBuffers(1, &clusters_buffer);
+	glDeleteBuffers(1, &light_indices_buffer);
+}
+
+void LightClusters::build(std::list< Scene::Light > const &scene_lights, Scene::Camera const &camera, glm::uvec2 const &drawable_size) {
+	assert(camera.transform);
+	assert(grid.x > 0 && grid.y > 0 && grid.z > 0);
+
+	lights.clear();
+	clusters.assign(grid.x * grid.y * grid.z, glm::uvec2(0));
+	light_indices.clear();
+
+	tile_size = glm::vec2(
+		std::ceil(float(drawable_size.x) / float(grid.x)),
+		std::ceil(float(drawable_size.y) / float(grid.y))
+	);
+	tile_size = glm::max(tile_size, glm::vec2(1.0f));
+	near_plane = camera.near;
+	slice_scale = float(grid.z) / std::log(std::max(slices_depth, 2.0f * near_plane) / near_plane);
+
+	auto push_light = [this](Scene::Light const &light, float range) {
+		glm::mat4x3 to_world = light.transform->make_local_to_world();
+		float type = 0.0f;
+		if      (light.type == Scene::Light::Point) type = 0.0f;
+		else if (light.type == Scene::Light::Hemisphere) type = 1.0f;
+		else if (light.type == Scene::Light::Spot) type = 2.0f;
+		else if (light.type == Scene::Light::Directional) type = 3.0f;
+		lights.emplace_back(to_world[3], type);
+		lights.emplace_back(-glm::normalize(to_world[2]), std::cos(0.5f * light.spot_fov));
+		lights.emplace_back(light.energy, range);
+	};
+
+	//global lights go first:
+	for (auto const &light : scene_lights) {
+		if (light.type == Scene::Light::Hemisphere || light.type == Scene::Light::Directional) {
+			push_light(light, 0.0f);
+		}
+	}
+	global_lights = uint32_t(lights.size() / 3);
+
+	//find the range of clusters touched by each local light:
+	struct Touched {
+		uint32_t light;
+		glm::uvec3 min, max; //inclusive
+	};
+	std::vector< Touched > touched;
+
+	glm::mat4x3 world_to_view = camera.transform->make_world_to_local();
+	glm::mat4 projection = camera.make_projection();
+
+	auto slice_of = [this](float depth) -> uint32_t {
+		if (depth <= near_plane) return 0;
+		float s = std::log(depth / near_plane) * slice_scale;
+		return uint32_t(std::min(s, float(grid.z - 1)));
+	};
+
+	for (auto const &light : scene_lights) {
+		if (!(light.type == Scene::Light::Point || light.type == Scene::Light::Spot)) continue;
+		assert(light.transform);
+
+		//lights fall off as energy / distance^2:
+		float brightest = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+		if (!(brightest > 0.0f)) continue;
+		float range = std::sqrt(brightest / min_intensity);
+
+		glm::vec3 center = world_to_view * glm::vec4(light.transform->make_local_to_world()[3], 1.0f);
+		float depth = -center.z;
+		if (depth + range < near_plane) continue; //entirely behind the camera
+
+		Touched t;
+		t.min.z = slice_of(depth - range);
+		t.max.z = slice_of(depth + range);
+
+		if (depth - range < near_plane) {
+			//sphere crosses the near plane, so it may cover the whole screen:
+			t.min.x = 0; t.max.x = grid.x - 1;
+			t.min.y = 0; t.max.y = grid.y - 1;
+		} else {
+			//project the sphere's bounding box to find the tiles it covers:
+			glm::vec2 lo = glm::vec2( std::numeric_limits< float >::infinity());
+			glm::vec2 hi = glm::vec2(-std::numeric_limits< float >::infinity());
+			for (uint32_t c = 0; c < 8; ++c) {
+				glm::vec3 corner = center + range * glm::vec3(
+					(c & 1 ? 1.0f : -1.0f),
+					(c & 2 ? 1.0f : -1.0f),
+					(c & 4 ? 1.0f : -1.0f)
+				);
+				glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				lo = glm::min(lo, ndc);
+				hi = glm::max(hi, ndc);
+			}
+			if (hi.x < -1.0f || hi.y < -1.0f || lo.x > 1.0f || lo.y > 1.0f) continue; //off screen
+			auto to_tile = [](float ndc, uint32_t count) -> uint32_t {
+				float tile = (ndc * 0.5f + 0.5f) * float(count);
+				return uint32_t(std::max(0.0f, std::min(tile, float(count - 1))));
+			};
+			t.min.x = to_tile(lo.x, grid.x); t.max.x = to_tile(hi.x, grid.x);
+			t.min.y = to_tile(lo.y, grid.y); t.max.y = to_tile(hi.y, grid.y);
+		}
+
+		t.light = uint32_t(lights.size() / 3);
+		push_light(light, range);
+		touched.emplace_back(t);
+	}
+
+	//count lights per cluster, then lay out the lists and fill them in:
+	auto cluster_index = [this](uint32_t x, uint32_t y, uint32_t z) {
+		return x + grid.x * (y + grid.y * z);
+	};
+	for (auto const &t : touched) {
+		for (uint32_t z = t.min.z; z <= t.max.z; ++z) {
+			for (uint32_t y = t.min.y; y <= t.max.y; ++y) {
+				for (uint32_t x = t.min.x; x <= t.max.x; ++x) {
+					clusters[cluster_index(x,y,z)].y += 1;
+				}
+			}
+		}
+	}
+	uint32_t total = 0;
+	for (auto &cluster : clusters) {
+		cluster.x = total;
+		total += cluster.y;
+		cluster.y = 0; //(re-counted while filling)
+	}
+	light_indices.resize(total);
+	for (auto const &t : touched) {
+		for (uint32_t z = t.min.z; z <= t.max.z; ++z) {
+			for (uint32_t y = t.min.y; y <= t.max.y; ++y) {
+				for (uint32_t x = t.min.x; x <= t.max.x; ++x) {
+					glm::uvec2 &cluster = clusters[cluster_index(x,y,z)];
+					light_indices[cluster.x + cluster.y] = t.light;
+					cluster.y += 1;
+				}
+			}
+		}
+	}
+}
+
+void LightClusters::upload() {
+	//n.b. buffers are never left empty, since zero-sized buffer textures upset some drivers:
+	auto upload_buffer = [](GLuint buffer, size_t size, void const *data) {
+		static glm::vec4 const dummy = glm::vec4(0.0f);
+		if (size == 0) {
+			size = sizeof(dummy);
+			data = &dummy;
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+		render_stats.current.bytes_uploaded += size;
+	};
+	upload_buffer(lights_buffer, lights.size() * sizeof(lights[0]), lights.data());
+	upload_buffer(clusters_buffer, clusters.size() * sizeof(clusters[0]), clusters.data());
+	upload_buffer(light_indices_buffer, light_indices.size() * sizeof(light_indices[0]), light_indices.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	GL_ERRORS();
+}
+
+void LightClusters::bind() const {
+	glActiveTexture(GL_TEXTURE0 + LightsTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, lights_texture);
+	glActiveTexture(GL_TEXTURE0 + ClustersTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, clusters_texture);
+	glActiveTexture(GL_TEXTURE0 + LightIndicesTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, light_indices_texture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::unbind() const {
+	for (GLuint unit : { LightsTextureUnit, ClustersTextureUnit, LightIndicesTextureUnit }) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
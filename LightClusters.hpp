@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * LightClusters bins a scene's lights into a grid of view-space clusters
+ *  (screen-space tiles x exponentially-spaced depth slices) on the CPU, so
+ *  that shaders only evaluate the lights that can reach each fragment.
+ *
+ * Each frame:
+ *  - build() computes the light data and per-cluster light lists,
+ *  - upload() sends them to OpenGL (once), and
+ *  - bind() makes them available to programs as buffer textures
+ *    (see LitColorTextureProgram for the matching GLSL).
+ *
+ * Hemisphere and directional lights reach everywhere, so they are not
+ *  binned; they come first in the light data and are always evaluated.
+ *
+ */
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <list>
+#include <vector>
+
+struct LightClusters {
+	LightClusters(); //creates buffers and textures; needs an OpenGL context
+	~LightClusters();
+
+	LightClusters(LightClusters const &) = delete;
+	LightClusters &operator=(LightClusters const &) = delete;
+
+	//cluster grid size (tiles across, tiles down, depth slices):
+	glm::uvec3 grid = glm::uvec3(16, 9, 24);
+	//depth slices are spaced exponentially from camera.near to this depth (the last slice extends to infinity):
+	float slices_depth = 100.0f;
+	//point and spot lights are treated as reaching until their (brightest channel of) energy falls off to this:
+	// (shaders fade lights out smoothly at this range, so there are no seams between clusters)
+	float min_intensity = 0.01f;
+
+	//bin lights for drawing from 'camera' into a viewport of 'drawable_size' pixels:
+	// (assumes the camera's projection is Camera::make_projection(), which is used to find fragment depths)
+	void build(std::list< Scene::Light > const &lights, Scene::Camera const &camera, glm::uvec2 const &drawable_size);
+
+	//send the most recently built data to OpenGL:
+	void upload();
+
+	//bind/unbind the buffer textures on their texture units:
+	void bind() const;
+	void unbind() const;
+
+	enum : uint32_t {
+		LightsTextureUnit = Scene::ObjectMatricesTextureUnit + 1, //RGBA32F, three texels per light (see 'lights' below)
+		ClustersTextureUnit, //RG32UI, (first, count) into light indices for each cluster
+		LightIndicesTextureUnit, //R32UI, light indices
+	};
+
+	//values for the shader's uniforms, computed by build():
+	uint32_t global_lights = 0; //number of lights (at the start of 'lights') that are evaluated everywhere
+	glm::vec2 tile_size = glm::vec2(1.0f); //size of a cluster in pixels
+	float near_plane = 0.01f; //camera near plane (used to find depth from gl_FragCoord.z)
+	float slice_scale = 1.0f; //slice = log(depth / near_plane) * slice_scale
+
+	//-- internals ---
+
+	//three texels per light:
+	// [ position.xyz, type ] (type: 0 = point, 1 = hemisphere, 2 = spot, 3 = directional)
+	// [ direction.xyz, cos(spot_fov / 2) ]
+	// [ energy.rgb, range ]
+	std::vector< glm::vec4 > lights;
+	//(first, count) in 'light_indices', for each cluster -- x fastest, then y, then z:
+	std::vector< glm::uvec2 > clusters;
+	std::vector< uint32_t > light_indices;
+
+	GLuint lights_buffer = 0, lights_texture = 0;
+	GLuint clusters_buffer = 0, clusters_texture = 0;
+	GLuint light_indices_buffer = 0, light_indices_texture = 0;
+};
@@ -2,26 +2,19 @@
 
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "LightClusters.hpp"
 
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
 
 Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
 	LitColorTextureProgram *ret = new LitColorTextureProgram();
 
-	//----- build the pipeline template -----
-	lit_color_texture_program_pipeline.program = ret->program;
+	//----- build the material and pipeline template -----
+	Scene::Material material;
+	material.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	material.DRAW_BASE_int = ret->DRAW_BASE_int;
+	material.depth_prepass = true;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -37,8 +30,10 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 
-	lit_color_texture_program_pipeline.textures[0].texture = tex;
-	lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
+	material.textures[0].texture = tex;
+	material.textures[0].target = GL_TEXTURE_2D;
+
+	lit_color_texture_program_pipeline.material = Scene::register_material(material);
 
 	return ret;
 });
@@ -48,10 +43,10 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	program = gl_compile_program(
 		//vertex shader:
 		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
+		"uniform samplerBuffer OBJECT_MATRICES;\n"
+		"uniform int DRAW_BASE;\n"
+		"layout(location = 0) in vec4 Position;\n" //(fixed location, so vertex arrays also work with DepthProgram)
+		"layout(location = 1) in float PaletteIndex;\n" //(part index for merged models; see PaletteBatch.hpp)
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
 		"in vec2 TexCoord;\n"
@@ -59,7 +54,19 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"invariant gl_Position;\n" //(must match DepthProgram exactly)
 		"void main() {\n"
+		"	//fetch this draw's matrices (layout as per Scene::ObjectMatrices):\n"
+		"	int base = 10 * (DRAW_BASE + gl_InstanceID + int(PaletteIndex));\n"
+		"	mat4 OBJECT_TO_CLIP = mat4(\n"
+		"		texelFetch(OBJECT_MATRICES, base+0), texelFetch(OBJECT_MATRICES, base+1),\n"
+		"		texelFetch(OBJECT_MATRICES, base+2), texelFetch(OBJECT_MATRICES, base+3));\n"
+		"	mat4x3 OBJECT_TO_LIGHT = transpose(mat3x4(\n"
+		"		texelFetch(OBJECT_MATRICES, base+4), texelFetch(OBJECT_MATRICES, base+5),\n"
+		"		texelFetch(OBJECT_MATRICES, base+6)));\n"
+		"	mat3 NORMAL_TO_LIGHT = mat3(\n"
+		"		texelFetch(OBJECT_MATRICES, base+7).xyz, texelFetch(OBJECT_MATRICES, base+8).xyz,\n"
+		"		texelFetch(OBJECT_MATRICES, base+9).xyz);\n"
 		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
 		"	position = OBJECT_TO_LIGHT * Position;\n"
 		"	normal = NORMAL_TO_LIGHT * Normal;\n"
@@ -70,37 +77,55 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		//fragment shader:
 		"#version 330\n"
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
+		"//lights, binned into clusters by LightClusters (see LightClusters.hpp for layouts):\n"
+		"uniform samplerBuffer LIGHTS;\n"
+		"uniform usamplerBuffer CLUSTERS;\n"
+		"uniform usamplerBuffer LIGHT_INDICES;\n"
+		"uniform int GLOBAL_LIGHTS;\n"
+		"uniform ivec3 CLUSTER_GRID;\n"
+		"uniform vec2 CLUSTER_TILE;\n"
+		"uniform float CLUSTER_NEAR;\n"
+		"uniform float CLUSTER_SLICE_SCALE;\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
 		"out vec4 fragColor;\n"
+		"vec3 light_energy(int light, vec3 n) {\n"
+		"	vec4 a = texelFetch(LIGHTS, 3*light+0); //position, type\n"
+		"	vec4 b = texelFetch(LIGHTS, 3*light+1); //direction, spot cutoff\n"
+		"	vec4 c = texelFetch(LIGHTS, 3*light+2); //energy, range\n"
+		"	if (a.w == 1.0) { //hemi light \n"
+		"		return (dot(n,-b.xyz) * 0.5 + 0.5) * c.rgb;\n"
+		"	} else if (a.w == 3.0) { //directional light \n"
+		"		return max(0.0, dot(n,-b.xyz)) * c.rgb;\n"
+		"	}\n"
+		"	//point or spot light:\n"
+		"	vec3 l = (a.xyz - position);\n"
+		"	float dis2 = dot(l,l);\n"
+		"	l = normalize(l);\n"
+		"	float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"	float window = clamp(1.0 - dis2 / (c.w * c.w), 0.0, 1.0); //fade out at range\n"
+		"	nl *= window * window;\n"
+		"	if (a.w == 2.0) { //spot light \n"
+		"		float cd = dot(l,-b.xyz);\n"
+		"		nl *= smoothstep(b.w,mix(b.w,1.0,0.1), cd);\n"
+		"	}\n"
+		"	return nl * c.rgb;\n"
+		"}\n"
 		"void main() {\n"
 		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	for (int i = 0; i < GLOBAL_LIGHTS; ++i) {\n"
+		"		e += light_energy(i, n);\n"
+		"	}\n"
+		"	//find this fragment's cluster (depth from the infinite perspective projection's z):\n"
+		"	float depth = CLUSTER_NEAR / max(1e-7, 1.0 - gl_FragCoord.z);\n"
+		"	ivec3 cell = ivec3(ivec2(gl_FragCoord.xy / CLUSTER_TILE), int(log(depth / CLUSTER_NEAR) * CLUSTER_SLICE_SCALE));\n"
+		"	cell = clamp(cell, ivec3(0), CLUSTER_GRID - ivec3(1));\n"
+		"	uvec2 cluster = texelFetch(CLUSTERS, cell.x + CLUSTER_GRID.x * (cell.y + CLUSTER_GRID.y * cell.z)).xy;\n"
+		"	for (uint i = cluster.x; i < cluster.x + cluster.y; ++i) {\n"
+		"		e += light_energy(int(texelFetch(LIGHT_INDICES, int(i)).x), n);\n"
 		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
@@ -114,25 +139,31 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Normal_vec3 = glGetAttribLocation(program, "Normal");
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
+	PaletteIndex_float = glGetAttribLocation(program, "PaletteIndex");
 
 	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
-
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	DRAW_BASE_int = glGetUniformLocation(program, "DRAW_BASE");
 
+	GLOBAL_LIGHTS_int = glGetUniformLocation(program, "GLOBAL_LIGHTS");
+	CLUSTER_GRID_ivec3 = glGetUniformLocation(program, "CLUSTER_GRID");
+	CLUSTER_TILE_vec2 = glGetUniformLocation(program, "CLUSTER_TILE");
+	CLUSTER_NEAR_float = glGetUniformLocation(program, "CLUSTER_NEAR");
+	CLUSTER_SLICE_SCALE_float = glGetUniformLocation(program, "CLUSTER_SLICE_SCALE");
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint OBJECT_MATRICES_samplerBuffer = glGetUniformLocation(program, "OBJECT_MATRICES");
+	GLuint LIGHTS_samplerBuffer = glGetUniformLocation(program, "LIGHTS");
+	GLuint CLUSTERS_usamplerBuffer = glGetUniformLocation(program, "CLUSTERS");
+	GLuint LIGHT_INDICES_usamplerBuffer = glGetUniformLocation(program, "LIGHT_INDICES");
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	glUniform1i(OBJECT_MATRICES_samplerBuffer, Scene::ObjectMatricesTextureUnit); //set OBJECT_MATRICES to sample from where Scene::draw binds it
+	glUniform1i(LIGHTS_samplerBuffer, LightClusters::LightsTextureUnit); //set light data to sample from where LightClusters::bind binds it
+	glUniform1i(CLUSTERS_usamplerBuffer, LightClusters::ClustersTextureUnit);
+	glUniform1i(LIGHT_INDICES_usamplerBuffer, LightClusters::LightIndicesTextureUnit);
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
@@ -5,6 +5,8 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// (lit by all lights binned by LightClusters)
+// (object matrices are read from Scene's per-frame object matrix buffer, so Scene::draw can draw repeated meshes with instancing)
 struct LitColorTextureProgram {
 	LitColorTextureProgram();
 	~LitColorTextureProgram();
@@ -16,25 +18,26 @@ struct LitColorTextureProgram {
 	GLuint Normal_vec3 = -1U;
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
+	GLuint PaletteIndex_float = -1U; //(optional; see PaletteBatch.hpp)
 
 	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
-
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
-	
+	GLuint DRAW_BASE_int = -1U; //matrices are read from OBJECT_MATRICES at draw id DRAW_BASE + gl_InstanceID + PaletteIndex
+
+	//lighting (per-frame values from LightClusters):
+	GLuint GLOBAL_LIGHTS_int = -1U;
+	GLuint CLUSTER_GRID_ivec3 = -1U;
+	GLuint CLUSTER_TILE_vec2 = -1U;
+	GLuint CLUSTER_NEAR_float = -1U;
+	GLuint CLUSTER_SLICE_SCALE_float = -1U;
+
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE0 + Scene::ObjectMatricesTextureUnit - object matrix buffer (bound by Scene::draw)
+	//TEXTURE0 + LightClusters::*TextureUnit - light data and cluster light lists (bound by LightClusters::bind)
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
 
 //For convenient scene-graph setup, copy this object:
-// NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: its material has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
@@ -0,0 +1,111 @@
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif //WINDOWS
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(std::string const &filename) {
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping (error " + std::to_string(GetLastError()) + ").");
+	}
+	file_handle = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "' (error " + std::to_string(GetLastError()) + ").");
+	}
+	size = size_t(file_size.QuadPart);
+	if (size == 0) return; //(can't map an empty file; leave data == nullptr)
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to create mapping for '" + filename + "' (error " + std::to_string(GetLastError()) + ").");
+	}
+	mapping_handle = mapping;
+
+	data = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map '" + filename + "' (error " + std::to_string(GetLastError()) + ").");
+	}
+}
+
+void MappedFile::release(void const *begin_, size_t length) const {
+	char const *begin_at = reinterpret_cast< char const * >(begin_);
+	if (!data || begin_at < data || begin_at >= data + size || length == 0) return;
+	size_t offset = size_t(begin_at - data);
+	length = std::min(length, size - offset);
+	//n.b. unlocking pages that aren't locked removes them from the working set (and "fails"; that's fine):
+	VirtualUnlock(const_cast< char * >(data + offset), length);
+}
+
+MappedFile::~MappedFile() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+}
+
+#else
+
+MappedFile::MappedFile(std::string const &filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping (" + std::strerror(errno) + ").");
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "' (" + std::strerror(errno) + ").");
+	}
+	size = size_t(info.st_size);
+	if (size == 0) { //(can't map an empty file; leave data == nullptr)
+		close(fd);
+		return;
+	}
+
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //(the mapping keeps its own reference to the file)
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map '" + filename + "' (" + std::strerror(errno) + ").");
+	}
+	data = reinterpret_cast< char const * >(mapped);
+}
+
+void MappedFile::release(void const *begin_, size_t length) const {
+	char const *begin_at = reinterpret_cast< char const * >(begin_);
+	if (!data || begin_at < data || begin_at >= data + size || length == 0) return;
+	size_t offset = size_t(begin_at - data);
+	length = std::min(length, size - offset);
+	//madvise wants page-aligned ranges; only whole pages inside the range are dropped:
+	static size_t const page = size_t(sysconf(_SC_PAGESIZE));
+	size_t begin = (offset + page - 1) / page * page;
+	size_t end = (offset + length == size ? size : (offset + length) / page * page);
+	if (begin >= end) return;
+	//n.b. the mapping is read-only, so dropped pages are just re-read from the file if touched:
+	madvise(const_cast< char * >(data + begin), end - begin, MADV_DONTNEED);
+}
+
+MappedFile::~MappedFile() {
+	if (data) munmap(const_cast< char * >(data), size);
+}
+
+#endif //WINDOWS
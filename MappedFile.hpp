@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * A MappedFile makes the contents of a file available as read-only memory
+ *  (using mmap or the Windows equivalent), so the OS pages data in as it is
+ *  touched rather than the program copying it into buffers.
+ *
+ * A MemoryStreambuf lets code that expects a std::istream read from memory
+ *  (e.g., from part of a MappedFile) without copying.
+ *
+ */
+
+#include <streambuf>
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map the whole file; throws on failure:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//mappings are owned, so copying is not allowed:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+	//hint that bytes [begin, begin + length) won't be read again soon, so the OS can drop their pages:
+	// (the data stays valid; touching it again just pages it back in from the file)
+	// (does nothing for memory outside the mapping, so callers needn't check where data came from)
+	void release(void const *begin, size_t length) const;
+
+	//--- internals ---
+	#if defined(_WIN32)
+	void *file_handle = nullptr; //HANDLE
+	void *mapping_handle = nullptr; //HANDLE
+	#endif
+};
+
+struct MemoryStreambuf : std::streambuf {
+	MemoryStreambuf(char const *begin, char const *end) {
+		//n.b. std::streambuf wants non-const pointers, but the get area is only read from:
+		setg(const_cast< char * >(begin), const_cast< char * >(begin), const_cast< char * >(end));
+	}
+};
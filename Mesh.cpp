@@ -1,64 +1,339 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "RenderStats.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <map>
 #include <set>
+#include <tuple>
+#include <unordered_map>
+#include <cassert>
 #include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_SSE2 1
+#include <emmintrin.h>
+#endif
 
 MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+	load(filename);
+	upload();
+}
 
-	std::ifstream file(filename, std::ios::binary);
+MeshBuffer::MeshBuffer(std::string const &filename, DeferUpload) {
+	load(filename);
+}
 
-	GLuint total = 0;
+//copy 'bytes' bytes from 'from' (in 'file') to 'buffer' at 'offset', one mapped slice at a time:
+// if 'index_offset' isn't zero, the data is 32-bit indices, and 'index_offset' is added to each as it is copied
+static void upload_slices(MappedFile const &file, uint8_t const *from, GLuint buffer, size_t offset, size_t bytes, uint32_t index_offset = 0) {
+	assert(index_offset == 0 || (offset % sizeof(uint32_t) == 0 && bytes % sizeof(uint32_t) == 0));
+	std::vector< uint32_t > offset_indices; //(only used if mapping fails)
+
+	//n.b. buffers are written through GL_ARRAY_BUFFER so as not to disturb whatever vertex array is bound:
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (size_t done = 0; done < bytes; /* later */) {
+		size_t slice = std::min(MeshBuffer::UploadSlice, bytes - done);
+		auto copy = [&](void *to) {
+			if (index_offset == 0) {
+				std::memcpy(to, from + done, slice);
+			} else {
+				//n.b. 'from' may not be aligned for uint32_t (see ChunkView), so go through memcpy:
+				for (size_t i = 0; i < slice; i += sizeof(uint32_t)) {
+					uint32_t index;
+					std::memcpy(&index, from + done + i, sizeof(uint32_t));
+					index += index_offset;
+					std::memcpy(reinterpret_cast< uint8_t * >(to) + i, &index, sizeof(uint32_t));
+				}
+			}
+		};
+		auto copy_sub_data = [&]() {
+			if (index_offset == 0) {
+				glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offset + done), GLsizeiptr(slice), from + done);
+			} else {
+				offset_indices.resize(slice / sizeof(uint32_t));
+				copy(offset_indices.data());
+				glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offset + done), GLsizeiptr(slice), offset_indices.data());
+			}
+		};
+		//n.b. the buffer is shared, and this range may have been freed by a buffer that was drawn from recently, so this isn't unsynchronized:
+		void *to = glMapBufferRange(GL_ARRAY_BUFFER, GLintptr(offset + done), GLsizeiptr(slice), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (to) {
+			copy(to);
+			if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+				//(contents were lost, e.g. to a display mode change; fall back to a copy)
+				copy_sub_data();
+			}
+		} else {
+			copy_sub_data();
+		}
+		render_stats.current.bytes_uploaded += slice;
+		file.release(from + done, slice);
+		done += slice;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+MeshBuffer::~MeshBuffer() {
+	//n.b. the arenas' buffers outlive this one, so cached vertex arrays referring to them stay (and are shared with other buffers):
+	VertexArena::vertices(quantized ? sizeof(QuantizedVertex) : sizeof(Vertex)).free(vertex_range);
+	VertexArena::elements().free(element_range);
+	buffer = 0;
+	elements = 0;
+}
+
+bool MeshBuffer::upload(size_t max_bytes) {
+	if (!mapped) return true; //(already uploaded)
+
+	size_t vertex_size = (quantized ? sizeof(QuantizedVertex) : sizeof(Vertex));
+
+	if (buffer == 0) {
+		//look up (making, if this is the first range in them) the arena buffers the ranges from load() are in:
+		buffer = VertexArena::vertices(vertex_size).buffer(vertex_range.block);
+		pending_uploaded = 0;
+
+		if (element_range.block != -1U) {
+			elements = VertexArena::elements().buffer(element_range.block);
+		}
+		pending_elements_uploaded = 0;
+	}
+
+	if (pending_uploaded < pending.size()) {
+		size_t bytes = std::min(max_bytes, pending.size() - pending_uploaded);
+		upload_slices(*mapped, pending.data() + pending_uploaded, buffer, size_t(vertex_range.first) * vertex_size + pending_uploaded, bytes);
+		pending_uploaded += bytes;
+		max_bytes -= bytes;
+	}
+
+	//indices go once the vertices are done (offset to where the vertices landed in the arena's buffer):
+	size_t element_bytes = pending_elements.size() * sizeof(uint32_t);
+	if (pending_uploaded == pending.size() && pending_elements_uploaded < element_bytes && max_bytes > 0) {
+		size_t bytes = std::min(max_bytes, element_bytes - pending_elements_uploaded);
+		upload_slices(*mapped, reinterpret_cast< uint8_t const * >(pending_elements.data()) + pending_elements_uploaded, elements, size_t(element_range.first) * sizeof(uint32_t) + pending_elements_uploaded, bytes, vertex_range.first);
+		pending_elements_uploaded += bytes;
+	}
+
+	if (pending_uploaded < pending.size() || pending_elements_uploaded < element_bytes) return false;
+
+	//done; unmap the file:
+	pending.elements = nullptr;
+	pending.count = 0;
+	pending_uploaded = 0;
+	pending_elements.elements = nullptr;
+	pending_elements.count = 0;
+	std::vector< uint32_t >().swap(pending_elements.unaligned_copy);
+	pending_elements_uploaded = 0;
+	mapped.reset();
+	return true;
+}
+
+//magic number of the chunk at 'at' (without reading past it), or "" if there are no more chunks:
+static std::string peek_magic(char const *at, char const *end) {
+	if (end - at < 4) return "";
+	return std::string(at, 4);
+}
+
+//bounding box of 'count' (at least one) vertices' positions:
+static void compute_bounds(MeshBuffer::Vertex const *vertices, uint32_t count, glm::vec3 *min_, glm::vec3 *max_) {
+	assert(count > 0);
+	assert(min_);
+	assert(max_);
+#ifdef MESH_SSE2
+	//n.b. loading four floats at Position also reads Normal.x, which is in bounds (and ignored):
+	static_assert(offsetof(MeshBuffer::Vertex, Normal) == offsetof(MeshBuffer::Vertex, Position) + 12, "Normal follows Position.");
+	__m128 lo = _mm_loadu_ps(&vertices[0].Position.x);
+	__m128 hi = lo;
+	for (uint32_t v = 1; v < count; ++v) {
+		__m128 p = _mm_loadu_ps(&vertices[v].Position.x);
+		lo = _mm_min_ps(lo, p);
+		hi = _mm_max_ps(hi, p);
+	}
+	alignas(16) float lo_f[4], hi_f[4];
+	_mm_store_ps(lo_f, lo);
+	_mm_store_ps(hi_f, hi);
+	*min_ = glm::vec3(lo_f[0], lo_f[1], lo_f[2]);
+	*max_ = glm::vec3(hi_f[0], hi_f[1], hi_f[2]);
+#else
+	glm::vec3 lo = vertices[0].Position;
+	glm::vec3 hi = lo;
+	for (uint32_t v = 1; v < count; ++v) {
+		lo = glm::min(lo, vertices[v].Position);
+		hi = glm::max(hi, vertices[v].Position);
+	}
+	*min_ = lo;
+	*max_ = hi;
+#endif
+}
 
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
+//decode half-float bits:
+static float half_to_float(uint16_t h) {
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	uint32_t bits;
+	if (exponent == 0) {
+		//zero or subnormal:
+		float f = std::ldexp(float(mantissa), -24);
+		std::memcpy(&bits, &f, sizeof(bits));
+		bits |= sign;
+	} else if (exponent == 31) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	float ret;
+	std::memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+//decode the xyz of a signed normalized 10:10:10:2 value:
+// (using OpenGL 3.3's rule, f = (2c + 1) / (2^b - 1), which is what the vertex fetch for GL_INT_2_10_10_10_REV does; cook-meshes encodes for it)
+static glm::vec3 decode_normal(uint32_t packed) {
+	auto component = [](uint32_t bits) {
+		int32_t c = int32_t(bits << 22) >> 22; //sign-extend ten bits
+		return float(2 * c + 1) / 1023.0f;
 	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	return glm::vec3(component(packed), component(packed >> 10), component(packed >> 20));
+}
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+//decode a quantized vertex to the '.pnct' layout:
+static MeshBuffer::Vertex decode_vertex(MeshBuffer::QuantizedVertex const &q, glm::vec3 const &position_scale, glm::vec3 const &position_offset) {
+	MeshBuffer::Vertex v;
+	v.Position = position_offset + position_scale * (glm::vec3(q.Position[0], q.Position[1], q.Position[2]) / 65535.0f);
+	v.Normal = decode_normal(q.Normal);
+	v.Color = q.Color;
+	v.TexCoord = glm::vec2(half_to_float(q.TexCoord[0]), half_to_float(q.TexCoord[1]));
+	return v;
+}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+void MeshBuffer::load(std::string const &filename) {
+	GLuint total = 0;
 
-		total = GLuint(data.size()); //store total for later checks on index
+	Vertex const *data = nullptr;
+	QuantizedVertex const *quantized_data = nullptr;
 
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+	//read data chunk:
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
+		mapped = std::make_unique< MappedFile >(filename);
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
+	char const *at = mapped->data;
+	char const *end = mapped->data + mapped->size;
+
+	quantized = (peek_magic(at, end) == "pncq");
+	size_t vertex_size = (quantized ? sizeof(QuantizedVertex) : sizeof(Vertex));
+	{
+		read_chunk(&at, end, quantized ? "pncq" : "pnct", &pending);
+		if (pending.size() % vertex_size != 0) {
+			throw std::runtime_error("Size of vertex chunk in '" + filename + "' not divisible by vertex size");
+		}
+		//n.b. vertex data starts just past the (8-byte) chunk header in a page-aligned mapping, so it is suitably aligned:
+		if (quantized) quantized_data = reinterpret_cast< QuantizedVertex const * >(pending.data());
+		else data = reinterpret_cast< Vertex const * >(pending.data());
+
+		total = GLuint(pending.size() / vertex_size); //store total for later checks on index
+
+		//store attrib locations:
+		if (quantized) {
+			//(positions are decoded by the object matrices; see Mesh::position_scale)
+			Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position));
+			//n.b. packed types must have size 4; shaders reading a vec3 just ignore w
+			Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Color));
+			TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoord));
+		} else {
+			Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+			Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+			TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+		}
+	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//cooked files have indices (into the vertices above) next:
+	bool indexed = (peek_magic(at, end) == "el32");
+	if (indexed) {
+		read_chunk(&at, end, "el32", &pending_elements);
+	}
+	if (quantized && !indexed) {
+		throw std::runtime_error("Quantized vertices in '" + filename + "' should be followed by indices.");
+	}
+
+	ChunkView< char > strings;
+	read_chunk(&at, end, "str0", &strings);
+
+	//mesh names (in 'entries' and 'name_index') point into a copy of the string table, since the file is unmapped after upload:
+	names.assign(strings.data(), strings.size());
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
+			uint32_t element_begin, element_end; //(only in indexed files' 'idx1', 'idx2', and 'idx3' chunks)
+			glm::vec3 min, max; //(only in 'idx2' and 'idx3' chunks; for quantized files, the box positions are quantized over)
+			glm::vec3 sphere_center; float sphere_radius; //(only in 'idx3' chunks)
 		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+		static_assert(sizeof(IndexEntry) == 64, "Index entry should be packed");
 
+		//which bounds the file stores (older files need them computed from the vertices):
+		bool has_box = false;
+		bool has_sphere = false;
+
+		//n.b. the index is small, so it is unpacked into a vector rather than read in place:
 		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		std::string index_magic = peek_magic(at, end);
+		if (indexed && index_magic == "idx3") {
+			ChunkView< IndexEntry > idx3;
+			read_chunk(&at, end, "idx3", &idx3);
+			index.assign(idx3.begin(), idx3.end());
+			has_box = has_sphere = true;
+		} else if (indexed && index_magic == "idx2") {
+			//'idx2' entries are the first eight fields:
+			struct BoxEntry {
+				uint32_t name_begin, name_end, vertex_begin, vertex_end, element_begin, element_end;
+				glm::vec3 min, max;
+			};
+			static_assert(sizeof(BoxEntry) == 48, "Index entry should be packed");
+			ChunkView< BoxEntry > idx2;
+			read_chunk(&at, end, "idx2", &idx2);
+			index.reserve(idx2.size());
+			for (auto const &e : idx2) {
+				index.emplace_back(IndexEntry{e.name_begin, e.name_end, e.vertex_begin, e.vertex_end, e.element_begin, e.element_end, e.min, e.max, glm::vec3(0.0f), 0.0f});
+			}
+			has_box = true;
+		} else if (quantized) {
+			throw std::runtime_error("Quantized vertices in '" + filename + "' need an index with bounds ('idx2' or 'idx3'), not '" + index_magic + "'.");
+		} else if (indexed) {
+			//'idx1' entries are the first six fields:
+			ChunkView< uint32_t > flat;
+			read_chunk(&at, end, "idx1", &flat);
+			if (flat.size() % 6 != 0) {
+				throw std::runtime_error("Size of idx1 chunk in '" + filename + "' not divisible by entry size");
+			}
+			index.reserve(flat.size() / 6);
+			for (size_t i = 0; i + 6 <= flat.size(); i += 6) {
+				index.emplace_back(IndexEntry{flat[i], flat[i+1], flat[i+2], flat[i+3], flat[i+4], flat[i+5], glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f});
+			}
+		} else {
+			//'idx0' entries are just the first four fields:
+			ChunkView< uint32_t > flat;
+			read_chunk(&at, end, "idx0", &flat);
+			if (flat.size() % 4 != 0) {
+				throw std::runtime_error("Size of idx0 chunk in '" + filename + "' not divisible by entry size");
+			}
+			index.reserve(flat.size() / 4);
+			for (size_t i = 0; i + 4 <= flat.size(); i += 4) {
+				index.emplace_back(IndexEntry{flat[i], flat[i+1], flat[i+2], flat[i+3], 0, 0, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f});
+			}
+		}
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -67,84 +342,329 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			if (indexed && !(entry.element_begin <= entry.element_end && entry.element_end <= pending_elements.size())) {
+				throw std::runtime_error("index entry has out-of-range element start/count");
+			}
+			std::string_view name = std::string_view(names).substr(entry.name_begin, entry.name_end - entry.name_begin);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			mesh.vertex_start = entry.vertex_begin;
+			mesh.vertex_count = entry.vertex_end - entry.vertex_begin;
+			if (indexed) {
+				for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+					if (!(entry.vertex_begin <= pending_elements[e] && pending_elements[e] < entry.vertex_end)) {
+						throw std::runtime_error("mesh '" + std::string(name) + "' in '" + filename + "' has indices outside its vertex range");
+					}
+				}
+				mesh.index_type = GL_UNSIGNED_INT;
+				mesh.start = entry.element_begin;
+				mesh.count = entry.element_end - entry.element_begin;
+			} else {
+				mesh.start = mesh.vertex_start;
+				mesh.count = mesh.vertex_count;
+			}
+			if (quantized) {
+				mesh.position_offset = entry.min;
+				mesh.position_scale = entry.max - entry.min;
+			}
+			if (entry.vertex_begin < entry.vertex_end) {
+				if (has_box) {
+					mesh.min = entry.min;
+					mesh.max = entry.max;
+				} else {
+					//older files: compute the box from the vertices:
+					compute_bounds(data + entry.vertex_begin, entry.vertex_end - entry.vertex_begin, &mesh.min, &mesh.max);
+				}
+				if (has_sphere) {
+					mesh.sphere_center = entry.sphere_center;
+					mesh.sphere_radius = entry.sphere_radius;
+				} else {
+					//(the box's bounding sphere; looser than the one cook-meshes stores, but needs no second pass)
+					mesh.sphere_center = 0.5f * (mesh.min + mesh.max);
+					mesh.sphere_radius = 0.5f * glm::length(mesh.max - mesh.min);
+				}
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
+			bool inserted = name_index.emplace(name, Handle(entries.size())).second;
 			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+				std::cerr << "WARNING: mesh name '" << name << "' in filename '" << filename << "' collides with existing mesh." << std::endl;
+			} else {
+				entries.emplace_back();
+				entries.back().mesh = mesh;
+				entries.back().name = name;
 			}
+			if (inserted && name.size() >= 9 && name.substr(name.size() - 9) == ".Occluder") {
+				std::vector< glm::vec3 > &positions = entries.back().occluder_positions;
+				positions.reserve(mesh.count);
+				uint32_t first = (indexed ? entry.element_begin : entry.vertex_begin);
+				for (uint32_t i = first; i < first + mesh.count; ++i) {
+					uint32_t v = (indexed ? pending_elements[i] : i);
+					if (quantized) positions.emplace_back(decode_vertex(quantized_data[v], mesh.position_scale, mesh.position_offset).Position);
+					else positions.emplace_back(data[v].Position);
+				}
+			}
+
+			//the checks above paged in this mesh's data; let it go again until upload() copies it:
+			// (so a large file is never resident all at once)
+			mapped->release(pending.data() + size_t(entry.vertex_begin) * vertex_size, size_t(entry.vertex_end - entry.vertex_begin) * vertex_size);
+			if (indexed) mapped->release(pending_elements.data() + entry.element_begin, size_t(entry.element_end - entry.element_begin) * sizeof(uint32_t));
+		}
+	}
+
+	//link meshes to their levels of detail and occluders (once, so lookups by handle don't build names):
+	std::string related;
+	for (auto &entry : entries) {
+		entry.lods.emplace_back(Handle(&entry - &entries[0]));
+		while (true) {
+			related.assign(entry.name);
+			related += ".LOD" + std::to_string(entry.lods.size());
+			Handle lod = find(related);
+			if (lod == InvalidHandle) break;
+			entry.lods.emplace_back(lod);
 		}
+		related.assign(entry.name);
+		related += ".Occluder";
+		entry.occluder = find(related);
 	}
 
-	if (file.peek() != EOF) {
+	if (at != end) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
+	//reserve space in the shared buffers (last, so nothing above can throw and leak it), and count meshes from there:
+	vertex_range = VertexArena::vertices(vertex_size).allocate(total);
+	if (indexed) {
+		try {
+			element_range = VertexArena::elements().allocate(uint32_t(pending_elements.size()));
+		} catch (...) {
+			VertexArena::vertices(vertex_size).free(vertex_range);
+			throw;
+		}
+	}
+	for (auto &entry : entries) {
+		entry.mesh.vertex_start += vertex_range.first;
+		entry.mesh.start += (indexed ? element_range.first : vertex_range.first);
+	}
+
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+	for (auto const &entry : entries) {
+		if (&entry == &entries.back() && entries.size() > 1) std::cout << " and";
+		std::cout << " '" << entry.name << "'";
+		if (&entry != &entries.back()) std::cout << ",";
 	}
 	std::cout << std::endl;
 	*/
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
-	}
+MeshBuffer::Handle MeshBuffer::find(std::string_view name) const {
+	auto f = name_index.find(name);
+	if (f == name_index.end()) return InvalidHandle;
 	return f->second;
 }
 
+std::vector< MeshBuffer::Handle > MeshBuffer::resolve(std::vector< std::string_view > const &names_) const {
+	std::vector< Handle > handles;
+	handles.reserve(names_.size());
+	for (auto const &name : names_) {
+		Handle handle = find(name);
+		if (handle == InvalidHandle) {
+			throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+		}
+		handles.emplace_back(handle);
+	}
+	return handles;
+}
+
+const Mesh &MeshBuffer::lookup(std::string_view name) const {
+	Handle handle = find(name);
+	if (handle == InvalidHandle) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return entries[handle].mesh;
+}
+
+std::vector< Mesh const * > MeshBuffer::lookup_lods(Handle handle) const {
+	std::vector< Mesh const * > lods;
+	for (Handle lod : entries.at(handle).lods) {
+		lods.emplace_back(&entries[lod].mesh);
+	}
+	return lods;
+}
+
+std::vector< Mesh const * > MeshBuffer::lookup_lods(std::string_view name) const {
+	Handle handle = find(name);
+	if (handle == InvalidHandle) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return lookup_lods(handle);
+}
+
+std::vector< glm::vec3 > const *MeshBuffer::lookup_occluder(Handle handle) const {
+	Handle occluder = entries.at(handle).occluder;
+	if (occluder == InvalidHandle) return nullptr;
+	return &entries[occluder].occluder_positions;
+}
+
+std::vector< glm::vec3 > const *MeshBuffer::lookup_occluder(std::string_view name) const {
+	Handle handle = find(name);
+	if (handle == InvalidHandle) return nullptr;
+	return lookup_occluder(handle);
+}
+
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+	return make_vao(program, buffer, elements, {
+		{"Position", Position},
+		{"Normal", Normal},
+		{"Color", Color},
+		{"TexCoord", TexCoord},
+	});
+}
+
+//state of one enabled attribute in a vertex array:
+struct VaoBinding {
+	GLuint location;
+	MeshBuffer::Attrib attrib;
+	bool operator<(VaoBinding const &o) const {
+		return std::tie(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, attrib.offset)
+		     < std::tie(o.location, o.attrib.size, o.attrib.type, o.attrib.normalized, o.attrib.stride, o.attrib.offset);
+	}
+};
+
+//everything a vertex array holds, as built by make_vao:
+struct VaoKey {
+	GLuint array_buffer;
+	GLuint element_buffer;
+	std::vector< VaoBinding > bindings; //(sorted by location)
+	bool operator<(VaoKey const &o) const {
+		return std::tie(array_buffer, element_buffer, bindings) < std::tie(o.array_buffer, o.element_buffer, o.bindings);
+	}
+};
+
+//active attributes (name -> location) of each program passed to make_vao:
+static std::unordered_map< GLuint, std::unordered_map< std::string, GLuint > > &program_attributes() {
+	static std::unordered_map< GLuint, std::unordered_map< std::string, GLuint > > attributes;
+	return attributes;
+}
+
+//vertex arrays built by make_vao:
+static std::map< VaoKey, GLuint > &vao_cache() {
+	static std::map< VaoKey, GLuint > cache;
+	return cache;
+}
+
+GLuint MeshBuffer::make_vao(GLuint program, GLuint array_buffer, GLuint element_buffer, std::vector< NamedAttrib > const &attribs) {
+	//look up (or query, the first time) the program's active attributes:
+	auto f = program_attributes().find(program);
+	if (f == program_attributes().end()) {
+		std::unordered_map< std::string, GLuint > active;
+		GLint count = 0;
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+		assert(count >= 0 && "Doesn't makes sense to have negative active attributes.");
+		for (GLuint i = 0; i < GLuint(count); ++i) {
+			GLchar name[100];
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
+			name[99] = '\0';
+			GLint location = glGetAttribLocation(program, name);
+			if (location == -1) continue; //(built-in inputs like gl_VertexID don't have locations)
+			active.emplace(name, GLuint(location));
+		}
+		f = program_attributes().emplace(program, std::move(active)).first;
+	}
+	std::unordered_map< std::string, GLuint > const &active = f->second;
+
+	//work out the bindings, checking that all active attributes get one:
+	VaoKey key;
+	key.array_buffer = array_buffer;
+	key.element_buffer = element_buffer;
+	std::set< GLuint > bound;
+	for (auto const &named : attribs) {
+		if (named.attrib.size == 0) continue; //don't bind empty attribs
+		auto a = active.find(named.name);
+		if (a == active.end()) continue; //can't bind missing attribs
+		key.bindings.emplace_back(VaoBinding{a->second, named.attrib});
+		bound.insert(a->second);
+	}
+	for (auto const &a : active) {
+		//PaletteIndex is only bound for merged models (see PaletteBatch.hpp); elsewhere it reads as zero:
+		if (a.first == "PaletteIndex") continue;
+		if (!bound.count(a.second)) {
+			throw std::runtime_error("ERROR: active attribute '" + a.first + "' in program is not bound.");
+		}
+	}
+	std::sort(key.bindings.begin(), key.bindings.end());
+
+	auto cached = vao_cache().find(key);
+	if (cached != vao_cache().end()) return cached->second;
+
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
-
-	//Try to bind all attributes in this buffer:
-	std::set< GLuint > bound;
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
-		if (attrib.size == 0) return; //don't bind empty attribs
-		GLint location = glGetAttribLocation(program, name);
-		if (location == -1) return; //can't bind missing attribs
-		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
-		glEnableVertexAttribArray(location);
-		bound.insert(location);
-	};
-	bind_attribute("Position", Position);
-	bind_attribute("Normal", Normal);
-	bind_attribute("Color", Color);
-	bind_attribute("TexCoord", TexCoord);
+	glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+	for (auto const &b : key.bindings) {
+		glVertexAttribPointer(b.location, b.attrib.size, b.attrib.type, b.attrib.normalized, b.attrib.stride, (GLbyte *)0 + b.attrib.offset);
+		glEnableVertexAttribArray(b.location);
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(element buffer binding is part of the vertex array's state, so it stays bound here)
+	if (element_buffer != 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
 	glBindVertexArray(0);
 
-	//Check that all active attributes were bound:
-	GLint active = 0;
-	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
-	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
-	for (GLuint i = 0; i < GLuint(active); ++i) {
-		GLchar name[100];
-		GLint size = 0;
-		GLenum type = 0;
-		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
-		name[99] = '\0';
-		GLint location = glGetAttribLocation(program, name);
-		if (!bound.count(GLuint(location))) {
-			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+	vao_cache().emplace(std::move(key), vao);
+	return vao;
+}
+
+void MeshBuffer::forget_buffer(GLuint buffer_) {
+	if (buffer_ == 0) return;
+	auto &cache = vao_cache();
+	for (auto v = cache.begin(); v != cache.end(); /* later */) {
+		if (v->first.array_buffer == buffer_ || v->first.element_buffer == buffer_) {
+			glDeleteVertexArrays(1, &v->second);
+			v = cache.erase(v);
+		} else {
+			++v;
 		}
 	}
+}
 
-	return vao;
+std::vector< MeshBuffer::Vertex > MeshBuffer::read_vertices(GLenum index_type, GLuint start, GLuint count, glm::vec3 const &position_scale, glm::vec3 const &position_offset) const {
+	std::vector< Vertex > ret(count);
+	if (count == 0) return ret;
+
+	//which vertices to read:
+	std::vector< uint32_t > indices(count);
+	if (index_type == GL_NONE) {
+		for (GLuint i = 0; i < count; ++i) indices[i] = start + i;
+	} else {
+		if (index_type != GL_UNSIGNED_INT || elements == 0) {
+			throw std::runtime_error("Reading back indexed vertices needs 32-bit indices in MeshBuffer::elements.");
+		}
+		//n.b. both buffers are read through GL_ARRAY_BUFFER so as not to disturb whatever vertex array is bound:
+		glBindBuffer(GL_ARRAY_BUFFER, elements);
+		glGetBufferSubData(GL_ARRAY_BUFFER, GLintptr(start) * sizeof(uint32_t), GLsizeiptr(indices.size() * sizeof(uint32_t)), indices.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//read just the range of vertices the indices use:
+	GLsizei stride = Position.stride; //n.b. all attributes share a stride
+	uint32_t first = *std::min_element(indices.begin(), indices.end());
+	uint32_t last = *std::max_element(indices.begin(), indices.end());
+	std::vector< uint8_t > vertices(size_t(last - first + 1) * stride);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glGetBufferSubData(GL_ARRAY_BUFFER, GLintptr(first) * stride, GLsizeiptr(vertices.size()), vertices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for (GLuint i = 0; i < count; ++i) {
+		uint8_t const *vertex = vertices.data() + size_t(indices[i] - first) * stride;
+		if (quantized) {
+			QuantizedVertex q;
+			std::memcpy(&q, vertex, sizeof(q));
+			ret[i] = decode_vertex(q, position_scale, position_offset);
+		} else {
+			std::memcpy(&ret[i], vertex, sizeof(Vertex));
+		}
+	}
+	return ret;
 }
@@ -4,51 +4,209 @@
  * In this code, "Mesh" is a range of vertices that should be sent through
  *  the OpenGL pipeline together.
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
- *  a single OpenGL array buffer. Individual meshes can be looked up by name
- *  using the MeshBuffer::lookup() function.
+ *  a range of an OpenGL array buffer. Individual meshes can be looked up by name
+ *  using the MeshBuffer::lookup() function, or -- when looking up many at
+ *  once, e.g. a scene's mesh table -- resolved to integer handles with
+ *  MeshBuffer::resolve() and fetched with MeshBuffer::get().
+ *
+ * Files written by export-meshes.py hold flat triangle lists; files cooked by
+ *  cook-meshes also hold indices into shared (deduplicated) vertices, which
+ *  go in a second, element array buffer. Meshes from such files are drawn
+ *  with glDrawElements.
+ *
+ * Cooked files store each mesh's bounding box and sphere in their index, so
+ *  loading them doesn't read vertex data on the CPU; for older files, the
+ *  box is computed from the vertices (and the sphere from the box).
+ *
+ * Cooked files may also store vertices in a compact, quantized layout
+ *  (MeshBuffer::QuantizedVertex, 20 bytes instead of 36). The attribute
+ *  descriptions let OpenGL unpack everything except positions, which are
+ *  stored relative to each mesh's bounds; Mesh::position_scale/offset say
+ *  how to decode them (Scene::Drawable::Pipeline folds this into the
+ *  object matrices, so shaders don't change).
+ *
+ * MeshBuffers don't make buffers of their own: their vertices and indices
+ *  are placed in ranges of large buffers shared by all files with the same
+ *  vertex layout (see VertexArena.hpp), so meshes from different files are
+ *  drawn with the same vertex array. Mesh::start and friends count from the
+ *  start of those shared buffers, and indices are offset to match as they
+ *  are uploaded.
  *
  */
 
 #include "GL.hpp"
+#include "MappedFile.hpp"
+#include "VertexArena.hpp"
+#include "read_write_chunk.hpp"
 #include <glm/glm.hpp>
-#include <map>
+#include <memory>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
 
 
 struct Mesh {
-	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
+	//Meshes are vertex ranges (and primitive types) in their MeshBuffer's buffers:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or, for indexed meshes, first index)
+	GLuint count = 0; //count of vertices (or, for indexed meshes, indices)
+	GLenum index_type = GL_NONE; //type of indices in MeshBuffer::elements, or GL_NONE for non-indexed meshes
+
+	//range of vertices the mesh uses (same as start/count for non-indexed meshes):
+	GLuint vertex_start = 0;
+	GLuint vertex_count = 0;
+
+	//positions in the buffer decode to object space as position_offset + position_scale * Position:
+	// (identity unless the buffer holds quantized vertices)
+	glm::vec3 position_scale = glm::vec3(1.0f);
+	glm::vec3 position_offset = glm::vec3(0.0f);
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Bounding sphere (negative radius if the mesh has no vertices):
+	glm::vec3 sphere_center = glm::vec3(0.0f);
+	float sphere_radius = -1.0f;
 };
 
 struct MeshBuffer {
+	//vertex layout of '.pnct' files (the 'pnct' chunk):
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	//compact vertex layout written by cook-meshes (the 'pncq' chunk):
+	struct QuantizedVertex {
+		uint16_t Position[3]; //unsigned normalized, over the mesh's bounds (see Mesh::position_scale)
+		uint16_t padding;
+		uint32_t Normal; //signed normalized 10:10:10:2 (GL_INT_2_10_10_10_REV), encoded for OpenGL 3.3's (2c + 1) / 1023 conversion
+		glm::u8vec4 Color;
+		uint16_t TexCoord[2]; //half floats
+	};
+	static_assert(sizeof(QuantizedVertex) == 20, "QuantizedVertex is packed.");
+
 	//construct from a file:
 	// note: will throw if file fails to read.
 	MeshBuffer(std::string const &filename);
 
+	//construct from a file without making any OpenGL calls (e.g., on a worker thread):
+	// the file stays mapped (see 'pending') until upload() is called from the thread that owns the GL context.
+	enum DeferUpload { Deferred };
+	MeshBuffer(std::string const &filename, DeferUpload);
+
+	//returns the buffer ranges to their arenas:
+	~MeshBuffer();
+
+	//buffer ranges are owned, so copying is not allowed:
+	MeshBuffer(MeshBuffer const &) = delete;
+	MeshBuffer &operator=(MeshBuffer const &) = delete;
+
+	//send deferred vertex data to OpenGL, at most 'max_bytes' per call (so uploads can be spread over frames):
+	// data is copied from the mapped file into mapped OpenGL buffers in slices of at most UploadSlice bytes,
+	// and each slice's file pages are released once copied, so memory use doesn't grow with the file size
+	// returns true once all data has been uploaded
+	bool upload(size_t max_bytes = std::numeric_limits< size_t >::max());
+	static constexpr size_t UploadSlice = 4 << 20;
+
+	//Meshes are also identified by handles -- indices in [0, mesh_count()), stable for the life of the buffer --
+	// so code that uses a mesh many times (e.g., when making a scene's drawables) only looks up its name once:
+	using Handle = uint32_t;
+	static constexpr Handle InvalidHandle = -1U;
+
+	//handle of the mesh named 'name' (InvalidHandle if there isn't one):
+	// (names are hashed, so this doesn't search)
+	Handle find(std::string_view name) const;
+
+	//handles of all of 'names' (e.g., a scene's mesh table; see the Scene::load overload that takes a resolver):
+	// note: will throw if any mesh is not found.
+	std::vector< Handle > resolve(std::vector< std::string_view > const &names) const;
+
+	uint32_t mesh_count() const { return uint32_t(entries.size()); }
+	Mesh const &get(Handle handle) const { return entries.at(handle).mesh; }
+	std::string_view name(Handle handle) const { return entries.at(handle).name; }
+
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
+	const Mesh &lookup(std::string_view name) const;
+
+	//look up a mesh along with any lower levels of detail exported as 'name.LOD1', 'name.LOD2', ...:
+	// (most detailed first; stops at the first missing level; throws if 'name' itself is missing)
+	std::vector< Mesh const * > lookup_lods(Handle handle) const;
+	std::vector< Mesh const * > lookup_lods(std::string_view name) const;
+
+	//look up the occluder triangles (see Scene::Drawable::occluder) exported for a mesh as a mesh named 'name.Occluder':
+	// returns nullptr if there is no such mesh
+	std::vector< glm::vec3 > const *lookup_occluder(Handle handle) const;
+	std::vector< glm::vec3 > const *lookup_occluder(std::string_view name) const;
 	
-	//build a vertex array object that links this vbo to attributes to a program:
+	//get a vertex array object that links this vbo to attributes to a program:
+	// (the element buffer, if any, is bound in the vertex array as well)
+	// (vertex arrays are cached -- see make_vao(), below -- so this is cheap to call again, and the result must not be deleted)
 	// note: will throw if program defines attributes not contained in this buffer
 	GLuint make_vao_for_program(GLuint program) const;
 
+	//read back (from the OpenGL buffers) the vertices drawn by 'count' vertices or indices starting at 'start':
+	// vertices are returned in draw order (i.e., indexed ranges are expanded) and decoded to the '.pnct' layout,
+	// using 'position_scale' and 'position_offset' (e.g., from Mesh or Scene::Drawable::Pipeline) for quantized positions
+	// (useful for code that merges meshes, since the CPU-side copy of the data is freed after upload)
+	std::vector< Vertex > read_vertices(GLenum index_type, GLuint start, GLuint count,
+		glm::vec3 const &position_scale = glm::vec3(1.0f), glm::vec3 const &position_offset = glm::vec3(0.0f)) const;
+
 	//This is the OpenGL vertex buffer object containing the mesh data:
+	// (shared with other MeshBuffers; set by upload())
 	GLuint buffer = 0;
 
+	//This is the OpenGL element buffer object containing indices for indexed meshes (0 if there are none):
+	// (also shared; set by upload())
+	GLuint elements = 0;
+
 	//-- internals ---
 
-	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	//meshes, indexed by handle (in file order):
+	struct Entry {
+		Mesh mesh;
+		std::string_view name; //(points into 'names')
+		std::vector< Handle > lods; //this mesh, then its lower levels of detail (used by lookup_lods())
+		Handle occluder = InvalidHandle; //the 'name.Occluder' mesh (used by lookup_occluder())
+		std::vector< glm::vec3 > occluder_positions; //(only for meshes whose names end in ".Occluder"; kept on the CPU after upload)
+	};
+	std::vector< Entry > entries;
+
+	//copy of the file's string table:
+	std::string names;
+
+	//used by find():
+	std::unordered_map< std::string_view, Handle > name_index;
+
+	//where the vertices and indices live in VertexArena::vertices() and VertexArena::elements():
+	// (allocated by load(); Mesh::start and friends already include these offsets)
+	VertexArena::Allocation vertex_range;
+	VertexArena::Allocation element_range;
+
+	//the file being loaded, mapped into memory until upload() finishes:
+	// (so vertex and index data are copied straight from the file into OpenGL buffers)
+	std::unique_ptr< MappedFile > mapped;
+
+	//vertex data (in 'mapped') waiting to be uploaded, and how much of it has been uploaded:
+	ChunkView< uint8_t > pending;
+	size_t pending_uploaded = 0;
+
+	//index data (in 'mapped') waiting to be uploaded (after the vertex data), and how much of it has been uploaded:
+	ChunkView< uint32_t > pending_elements;
+	size_t pending_elements_uploaded = 0; //(in bytes)
+
+	//map the file and read it into 'meshes', 'pending', and the attrib descriptions below, and allocate buffer ranges (no OpenGL calls):
+	void load(std::string const &filename);
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -67,4 +225,27 @@ struct MeshBuffer {
 	Attrib Normal;
 	Attrib Color;
 	Attrib TexCoord;
+
+	//--- vertex array cache ---
+
+	//an attribute, by the name programs use for it:
+	struct NamedAttrib {
+		char const *name;
+		Attrib attrib;
+	};
+
+	//get a vertex array object that binds 'attribs' (data in 'array_buffer') and 'element_buffer' (if not 0) for 'program':
+	// vertex arrays are cached by the bindings they end up holding (buffers, attribute locations, and formats), so
+	// requests that would build identical vertex arrays -- e.g., the same buffer for several programs that put their
+	// attributes at the same locations -- share one; each program's attribute locations are also only queried once.
+	// cached vertex arrays belong to the cache: don't delete them (use forget_buffer() before deleting their buffers)
+	// note: will throw if program has active attributes not in 'attribs' (other than PaletteIndex; see PaletteBatch.hpp)
+	// note: programs are assumed to never be deleted (true of all the Load<>'d programs here)
+	static GLuint make_vao(GLuint program, GLuint array_buffer, GLuint element_buffer, std::vector< NamedAttrib > const &attribs);
+
+	//delete any cached vertex arrays that refer to 'buffer' (so a buffer with a recycled name doesn't match them):
+	static void forget_buffer(GLuint buffer);
+
+	//does the buffer hold QuantizedVertex (rather than Vertex) data?
+	bool quantized = false;
 };
@@ -0,0 +1,317 @@
+#include "OcclusionBuffer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_BUFFER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width_, uint32_t height_, uint32_t threads) : width((width_ + 3) & ~3U), height(height_) {
+	assert(width > 0 && height > 0);
+
+	//allocate the depth pyramid, down to a single texel:
+	levels.emplace_back();
+	levels.back().width = width;
+	levels.back().height = height;
+	while (levels.back().width > 1 || levels.back().height > 1) {
+		Level next;
+		next.width = (levels.back().width + 1) / 2;
+		next.height = (levels.back().height + 1) / 2;
+		levels.emplace_back(next);
+	}
+	for (auto &level : levels) {
+		level.depth.assign(level.width * level.height, 0.0f);
+	}
+
+	if (threads == 0) {
+		//(a few threads is plenty for a buffer this small)
+		threads = std::max(1U, std::min(4U, std::thread::hardware_concurrency()));
+	}
+	for (uint32_t i = 1; i < threads; ++i) {
+		workers.emplace_back(&OcclusionBuffer::worker_main, this);
+	}
+}
+
+OcclusionBuffer::~OcclusionBuffer() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	start_cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void OcclusionBuffer::begin(glm::mat4 const &world_to_clip_) {
+	world_to_clip = world_to_clip_;
+	triangles.clear();
+	std::fill(levels[0].depth.begin(), levels[0].depth.end(), 0.0f);
+}
+
+void OcclusionBuffer::add_occluder(glm::mat4x3 const &object_to_world, std::vector< glm::vec3 > const &object_triangles) {
+	assert(object_triangles.size() % 3 == 0);
+	glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+
+	//clip space -> (pixel x, pixel y, 1/w):
+	auto project = [this](glm::vec4 const &clip) {
+		float inv_w = 1.0f / clip.w;
+		return glm::vec3(
+			(clip.x * inv_w * 0.5f + 0.5f) * float(width),
+			(clip.y * inv_w * 0.5f + 0.5f) * float(height),
+			inv_w
+		);
+	};
+
+	for (size_t i = 0; i + 2 < object_triangles.size(); i += 3) {
+		glm::vec4 clip[3];
+		for (uint32_t j = 0; j < 3; ++j) {
+			clip[j] = object_to_clip * glm::vec4(object_triangles[i+j], 1.0f);
+		}
+
+		//reject triangles that are entirely outside one of the side or near planes:
+		auto outside = [&clip](glm::vec4 const &plane) {
+			return glm::dot(plane, clip[0]) < 0.0f && glm::dot(plane, clip[1]) < 0.0f && glm::dot(plane, clip[2]) < 0.0f;
+		};
+		if (outside(glm::vec4( 1.0f, 0.0f, 0.0f, 1.0f))) continue;
+		if (outside(glm::vec4(-1.0f, 0.0f, 0.0f, 1.0f))) continue;
+		if (outside(glm::vec4( 0.0f, 1.0f, 0.0f, 1.0f))) continue;
+		if (outside(glm::vec4( 0.0f,-1.0f, 0.0f, 1.0f))) continue;
+		if (outside(glm::vec4( 0.0f, 0.0f, 1.0f, 1.0f))) continue;
+
+		//clip against the near plane (z >= -w), giving a polygon with up to four vertices:
+		glm::vec3 poly[4];
+		uint32_t poly_count = 0;
+		for (uint32_t j = 0; j < 3; ++j) {
+			glm::vec4 const &a = clip[j];
+			glm::vec4 const &b = clip[(j+1)%3];
+			float da = a.z + a.w;
+			float db = b.z + b.w;
+			if (da >= 0.0f) poly[poly_count++] = project(a);
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				poly[poly_count++] = project(glm::mix(a, b, da / (da - db)));
+			}
+		}
+		assert(poly_count <= 4);
+
+		for (uint32_t j = 1; j + 1 < poly_count; ++j) {
+			ScreenTriangle tri;
+			tri.v[0] = poly[0];
+			tri.v[1] = poly[j];
+			tri.v[2] = poly[j+1];
+
+			//drop back-facing (clockwise on screen) and degenerate triangles:
+			glm::vec2 ab = glm::vec2(tri.v[1]) - glm::vec2(tri.v[0]);
+			glm::vec2 ac = glm::vec2(tri.v[2]) - glm::vec2(tri.v[0]);
+			if (ab.x * ac.y - ab.y * ac.x <= 0.0f) continue;
+
+			//rows whose pixel centers might be covered:
+			float y_min = std::min(tri.v[0].y, std::min(tri.v[1].y, tri.v[2].y));
+			float y_max = std::max(tri.v[0].y, std::max(tri.v[1].y, tri.v[2].y));
+			tri.y_begin = int32_t(std::max(0.0f, std::ceil(y_min - 0.5f)));
+			tri.y_end = int32_t(std::min(float(height), std::floor(y_max - 0.5f) + 1.0f));
+			if (tri.y_begin >= tri.y_end) continue;
+
+			triangles.emplace_back(tri);
+		}
+	}
+}
+
+void OcclusionBuffer::finish() {
+	//rasterize (on this thread and any workers):
+	next_band = 0;
+	if (!workers.empty()) {
+		std::lock_guard< std::mutex > lock(mutex);
+		++generation;
+		busy = uint32_t(workers.size());
+	}
+	start_cv.notify_all();
+	rasterize_bands();
+	if (!workers.empty()) {
+		std::unique_lock< std::mutex > lock(mutex);
+		done_cv.wait(lock, [this](){ return busy == 0; });
+	}
+
+	//build the pyramid, each texel holding the farthest (smallest) depth below it:
+	for (size_t l = 1; l < levels.size(); ++l) {
+		Level const &src = levels[l-1];
+		Level &dst = levels[l];
+		for (uint32_t y = 0; y < dst.height; ++y) {
+			uint32_t y0 = 2 * y;
+			uint32_t y1 = std::min(2 * y + 1, src.height - 1);
+			for (uint32_t x = 0; x < dst.width; ++x) {
+				uint32_t x0 = 2 * x;
+				uint32_t x1 = std::min(2 * x + 1, src.width - 1);
+				dst.depth[y * dst.width + x] = std::min(
+					std::min(src.depth[y0 * src.width + x0], src.depth[y0 * src.width + x1]),
+					std::min(src.depth[y1 * src.width + x0], src.depth[y1 * src.width + x1])
+				);
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::visible(BVH::AABB const &world_box) const {
+	if (world_box.empty() || triangles.empty()) return true;
+
+	//screen-space rectangle and nearest depth of the box:
+	glm::vec2 lo = glm::vec2( std::numeric_limits< float >::infinity());
+	glm::vec2 hi = glm::vec2(-std::numeric_limits< float >::infinity());
+	float nearest = 0.0f;
+	for (uint32_t c = 0; c < 8; ++c) {
+		glm::vec3 corner = glm::vec3(
+			(c & 1 ? world_box.max.x : world_box.min.x),
+			(c & 2 ? world_box.max.y : world_box.min.y),
+			(c & 4 ? world_box.max.z : world_box.min.z)
+		);
+		glm::vec4 clip = world_to_clip * glm::vec4(corner, 1.0f);
+		if (clip.z < -clip.w || clip.w <= 0.0f) return true; //crosses the near plane
+		float inv_w = 1.0f / clip.w;
+		glm::vec2 px = glm::vec2(
+			(clip.x * inv_w * 0.5f + 0.5f) * float(width),
+			(clip.y * inv_w * 0.5f + 0.5f) * float(height)
+		);
+		lo = glm::min(lo, px);
+		hi = glm::max(hi, px);
+		nearest = std::max(nearest, inv_w);
+	}
+
+	int32_t x0 = std::max(0, int32_t(std::floor(lo.x)));
+	int32_t y0 = std::max(0, int32_t(std::floor(lo.y)));
+	int32_t x1 = std::min(int32_t(width) - 1, int32_t(std::floor(hi.x)));
+	int32_t y1 = std::min(int32_t(height) - 1, int32_t(std::floor(hi.y)));
+	if (x0 > x1 || y0 > y1) return true; //off screen (the frustum test should have caught this)
+
+	//use the finest level at which the rectangle touches at most 2x2 texels:
+	uint32_t l = 0;
+	while (l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1)) ++l;
+
+	Level const &level = levels[l];
+	for (int32_t y = y0 >> l; y <= (y1 >> l); ++y) {
+		for (int32_t x = x0 >> l; x <= (x1 >> l); ++x) {
+			//visible if any occluder texel isn't strictly nearer than the box:
+			if (level.depth[y * level.width + x] <= nearest) return true;
+		}
+	}
+	return false;
+}
+
+//-------------------------
+
+void OcclusionBuffer::rasterize_bands() {
+	uint32_t bands = (height + BandRows - 1) / BandRows;
+	while (true) {
+		uint32_t band = next_band.fetch_add(1);
+		if (band >= bands) break;
+		int32_t row_begin = int32_t(band * BandRows);
+		int32_t row_end = int32_t(std::min(height, (band + 1) * BandRows));
+		for (auto const &tri : triangles) {
+			if (tri.y_end <= row_begin || tri.y_begin >= row_end) continue;
+			rasterize(tri, std::max(row_begin, tri.y_begin), std::min(row_end, tri.y_end));
+		}
+	}
+}
+
+void OcclusionBuffer::rasterize(ScreenTriangle const &tri, int32_t row_begin, int32_t row_end) {
+	glm::vec3 const &v0 = tri.v[0];
+	glm::vec3 const &v1 = tri.v[1];
+	glm::vec3 const &v2 = tri.v[2];
+
+	//columns whose pixel centers might be covered:
+	float x_min = std::min(v0.x, std::min(v1.x, v2.x));
+	float x_max = std::max(v0.x, std::max(v1.x, v2.x));
+	int32_t x_begin = int32_t(std::max(0.0f, std::ceil(x_min - 0.5f)));
+	int32_t x_end = int32_t(std::min(float(width), std::floor(x_max - 0.5f) + 1.0f));
+	if (x_begin >= x_end) return;
+
+	//edge functions (a * x + b * y + c, non-negative inside a counter-clockwise triangle):
+	struct Edge {
+		float a, b, c;
+		Edge(glm::vec3 const &from, glm::vec3 const &to) : a(from.y - to.y), b(to.x - from.x), c(-(a * from.x + b * from.y)) { }
+		float at(float x, float y) const { return a * x + b * y + c; }
+	};
+	Edge e0(v1, v2), e1(v2, v0), e2(v0, v1);
+
+	//depth plane:
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	float dz_dx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+	float dz_dy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+	auto z_at = [&](float x, float y) { return v0.z + dz_dx * (x - v0.x) + dz_dy * (y - v0.y); };
+
+	float *depth = levels[0].depth.data();
+
+#ifdef OCCLUSION_BUFFER_SSE2
+	//four pixels at a time; start on a multiple of four (width is one, so the last group stays in the row):
+	x_begin &= ~3;
+	__m128 const lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const step0 = _mm_set1_ps(4.0f * e0.a);
+	__m128 const step1 = _mm_set1_ps(4.0f * e1.a);
+	__m128 const step2 = _mm_set1_ps(4.0f * e2.a);
+	__m128 const step_z = _mm_set1_ps(4.0f * dz_dx);
+	for (int32_t y = row_begin; y < row_end; ++y) {
+		float px = float(x_begin) + 0.5f;
+		float py = float(y) + 0.5f;
+		__m128 w0 = _mm_add_ps(_mm_set1_ps(e0.at(px, py)), _mm_mul_ps(_mm_set1_ps(e0.a), lane));
+		__m128 w1 = _mm_add_ps(_mm_set1_ps(e1.at(px, py)), _mm_mul_ps(_mm_set1_ps(e1.a), lane));
+		__m128 w2 = _mm_add_ps(_mm_set1_ps(e2.at(px, py)), _mm_mul_ps(_mm_set1_ps(e2.a), lane));
+		__m128 z = _mm_add_ps(_mm_set1_ps(z_at(px, py)), _mm_mul_ps(_mm_set1_ps(dz_dx), lane));
+		float *row = depth + y * width;
+		for (int32_t x = x_begin; x < x_end; x += 4) {
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+			if (_mm_movemask_ps(inside)) {
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_max_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+			w0 = _mm_add_ps(w0, step0);
+			w1 = _mm_add_ps(w1, step1);
+			w2 = _mm_add_ps(w2, step2);
+			z = _mm_add_ps(z, step_z);
+		}
+	}
+#else
+	for (int32_t y = row_begin; y < row_end; ++y) {
+		float px = float(x_begin) + 0.5f;
+		float py = float(y) + 0.5f;
+		float w0 = e0.at(px, py);
+		float w1 = e1.at(px, py);
+		float w2 = e2.at(px, py);
+		float z = z_at(px, py);
+		float *row = depth + y * width;
+		for (int32_t x = x_begin; x < x_end; ++x) {
+			if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) {
+				row[x] = std::max(row[x], z);
+			}
+			w0 += e0.a;
+			w1 += e1.a;
+			w2 += e2.a;
+			z += dz_dx;
+		}
+	}
+#endif
+}
+
+//-------------------------
+
+void OcclusionBuffer::worker_main() {
+	uint32_t seen = 0;
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		start_cv.wait(lock, [&](){ return quit || generation != seen; });
+		if (quit) break;
+		seen = generation;
+
+		lock.unlock();
+		rasterize_bands();
+		lock.lock();
+
+		assert(busy > 0);
+		--busy;
+		if (busy == 0) done_cv.notify_one();
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+/*
+ * An OcclusionBuffer is a small CPU-side depth buffer used to skip drawing
+ *  things that are hidden behind big occluders (walls, terrain, ...).
+ *
+ * Each frame, a handful of low-polygon occluder meshes are rasterized into
+ *  the buffer (rows are split into bands, which are filled in parallel by
+ *  worker threads; the inner loop uses SSE2 when available). A min-depth
+ *  pyramid ("hierarchical z") is then built over the result, so testing a
+ *  bounding box only needs to read a few texels.
+ *
+ * Depth is stored as 1/w (so larger is nearer, and 0 means "no occluder"),
+ *  which interpolates linearly across screen-space triangles.
+ *
+ */
+
+#include "BVH.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+struct OcclusionBuffer {
+	//'width' is rounded up to a multiple of four; 'threads' includes the calling thread (0 means "pick based on the hardware"):
+	OcclusionBuffer(uint32_t width = 256, uint32_t height = 128, uint32_t threads = 0);
+	//stops worker threads:
+	~OcclusionBuffer();
+
+	OcclusionBuffer(OcclusionBuffer const &) = delete;
+	OcclusionBuffer &operator=(OcclusionBuffer const &) = delete;
+
+	//start a new frame (clears the buffer and the occluder list):
+	void begin(glm::mat4 const &world_to_clip);
+
+	//add an occluder, given as a triangle list in object space (three vertices per triangle):
+	// (back-facing and off-screen triangles are dropped; triangles crossing the near plane are clipped)
+	void add_occluder(glm::mat4x3 const &object_to_world, std::vector< glm::vec3 > const &triangles);
+
+	//rasterize all occluders and build the depth pyramid:
+	void finish();
+
+	//is any part of a world-space box possibly in front of the occluders?
+	// (conservative: boxes that cross the near plane or fall outside the buffer are always visible)
+	bool visible(BVH::AABB const &world_box) const;
+
+	//-- internals ---
+
+	uint32_t width, height;
+	glm::mat4 world_to_clip = glm::mat4(1.0f);
+
+	//occluder triangles after projection: x,y in pixels, z = 1/w:
+	struct ScreenTriangle {
+		glm::vec3 v[3];
+		int32_t y_begin, y_end; //rows touched, clamped to the buffer
+	};
+	std::vector< ScreenTriangle > triangles;
+
+	//levels[0] is the full-resolution buffer; level i + 1 holds the minimum of 2x2 texels of level i:
+	struct Level {
+		uint32_t width = 0, height = 0;
+		std::vector< float > depth;
+	};
+	std::vector< Level > levels;
+
+	//rows are rasterized in bands of this many rows; bands are handed out through 'next_band':
+	enum : uint32_t { BandRows = 8 };
+	std::atomic< uint32_t > next_band{0};
+	void rasterize_bands();
+	void rasterize(ScreenTriangle const &tri, int32_t row_begin, int32_t row_end);
+
+	//worker threads wait for 'generation' to change, then help with rasterize_bands():
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+	uint32_t generation = 0;
+	uint32_t busy = 0;
+	bool quit = false;
+	void worker_main();
+};
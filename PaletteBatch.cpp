@@ -0,0 +1,129 @@
+#include "PaletteBatch.hpp"
+
+#include "gl_errors.hpp"
+#include "RenderStats.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+#include <cstring>
+#include <cstddef>
+
+PaletteBatch::PaletteBatch(Scene &scene, Scene::Transform *root, MeshBuffer const &source, GLuint source_vao) {
+	assert(root);
+
+	//find the parts:
+	auto in_hierarchy = [root](Scene::Transform const *t) {
+		for (; t != nullptr; t = t->parent) {
+			if (t == root) return true;
+		}
+		return false;
+	};
+	std::vector< Scene::Drawable * > parts;
+	for (auto &d : scene.drawables) {
+		if (d.pipeline.vao != source_vao || d.pipeline.type != GL_TRIANGLES) continue;
+		if (d.lod_count != 0 || d.palette_count != 0) continue;
+		if (!parts.empty() && d.pipeline.material != parts[0]->pipeline.material) continue;
+		if (!in_hierarchy(d.transform)) continue;
+		if (parts.size() == MaxParts) {
+			std::cerr << "WARNING: more than " << MaxParts << " parts under '" << root->name() << "'; not merging the rest." << std::endl;
+			break;
+		}
+		parts.emplace_back(&d);
+	}
+	if (parts.size() < 2) return;
+
+	Scene::Material const &material = Scene::get_material(parts[0]->pipeline.material);
+	if (material.DRAW_BASE_int == -1U) {
+		throw std::runtime_error("Palette drawables need a material that reads matrices by draw id.");
+	}
+
+	//copy the parts' vertices (read back from the source buffer, expanded if indexed, and decoded if quantized), appending a palette index to each:
+	GLsizei stride = sizeof(MeshBuffer::Vertex);
+	GLsizei merged_stride = stride + 4; //(index byte + padding, to keep floats aligned)
+	GLuint total = 0;
+	for (auto const *part : parts) total += part->pipeline.count;
+
+	std::vector< uint8_t > data(size_t(total) * merged_stride, 0);
+	GLuint at = 0;
+	for (uint32_t i = 0; i < parts.size(); ++i) {
+		Scene::Drawable::Pipeline const &pipeline = parts[i]->pipeline;
+		std::vector< MeshBuffer::Vertex > part_data = source.read_vertices(pipeline.index_type, pipeline.start, pipeline.count, pipeline.position_scale, pipeline.position_offset);
+		for (GLuint v = 0; v < pipeline.count; ++v) {
+			uint8_t *dst = data.data() + size_t(at + v) * merged_stride;
+			std::memcpy(dst, &part_data[v], stride);
+			dst[stride] = uint8_t(i);
+		}
+		at += pipeline.count;
+	}
+
+	if (glGetAttribLocation(material.program, "PaletteIndex") == -1) {
+		throw std::runtime_error("Palette drawables need a program with a PaletteIndex attribute.");
+	}
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+	render_stats.current.bytes_uploaded += data.size();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//bind attributes as in MeshBuffer::make_vao_for_program (but in the unquantized layout), plus PaletteIndex:
+	auto merged_attrib = [&](MeshBuffer::Attrib const &attrib, GLint size, GLenum type, GLboolean normalized, GLuint offset) {
+		if (attrib.size == 0) return MeshBuffer::Attrib(); //(source didn't have it)
+		return MeshBuffer::Attrib(size, type, normalized, merged_stride, offset);
+	};
+	vao = MeshBuffer::make_vao(material.program, buffer, 0, {
+		{"Position", merged_attrib(source.Position, 3, GL_FLOAT, GL_FALSE, offsetof(MeshBuffer::Vertex, Position))},
+		{"Normal", merged_attrib(source.Normal, 3, GL_FLOAT, GL_FALSE, offsetof(MeshBuffer::Vertex, Normal))},
+		{"Color", merged_attrib(source.Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(MeshBuffer::Vertex, Color))},
+		{"TexCoord", merged_attrib(source.TexCoord, 2, GL_FLOAT, GL_FALSE, offsetof(MeshBuffer::Vertex, TexCoord))},
+		{"PaletteIndex", MeshBuffer::Attrib(1, GL_UNSIGNED_BYTE, GL_FALSE, merged_stride, stride)},
+	});
+
+	GL_ERRORS();
+
+	//make the merged drawable:
+	// (its bounds are fit around the parts by Scene::update_bvh, below)
+	Scene::Drawable merged(root);
+	merged.pipeline = parts[0]->pipeline;
+	merged.pipeline.vao = vao;
+	merged.pipeline.start = 0;
+	merged.pipeline.count = total;
+	merged.pipeline.index_type = GL_NONE;
+	merged.pipeline.position_scale = glm::vec3(1.0f);
+	merged.pipeline.position_offset = glm::vec3(0.0f);
+	merged.palette_begin = uint32_t(scene.palette.size());
+	merged.palette_count = uint32_t(parts.size());
+	for (auto const *part : parts) {
+		scene.palette.emplace_back();
+		scene.palette.back().transform = part->transform;
+		scene.palette.back().min = part->min;
+		scene.palette.back().max = part->max;
+		scene.palette.back().sphere_center = part->sphere_center;
+		scene.palette.back().sphere_radius = part->sphere_radius;
+	}
+
+	//remove the parts:
+	std::unordered_set< Scene::Drawable const * > merging(parts.begin(), parts.end());
+	for (auto d = scene.drawables.begin(); d != scene.drawables.end(); /* later */) {
+		if (merging.count(&*d)) {
+			if (d->bvh_leaf != -1U) scene.bvh.remove(d->bvh_leaf);
+			d = scene.drawables.erase(d);
+		} else {
+			++d;
+		}
+	}
+
+	scene.drawables.emplace_back(merged);
+	drawable = &scene.drawables.back();
+	scene.update_bvh();
+}
+
+PaletteBatch::~PaletteBatch() {
+	vao = 0; //(owned by MeshBuffer's vertex array cache)
+	MeshBuffer::forget_buffer(buffer);
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
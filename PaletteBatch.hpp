@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * A PaletteBatch merges the parts of a rigid, articulated model (e.g., the
+ *  hexapod's body, hips, and legs) into a single drawable.
+ *
+ * The parts' vertices are copied into one buffer, each vertex tagged with the
+ *  index of the part it came from ("PaletteIndex"). The merged drawable's
+ *  palette (a range of Scene::palette) lists the part transforms and bounds;
+ *  Scene::record stores one set of matrices per palette entry and the vertex
+ *  shader picks the matching one, so the whole model is drawn with one call
+ *  while parts still move freely. (Scene::update_bvh refits the drawable's
+ *  bounds to the parts' current poses.)
+ *
+ * Programs used with palette drawables must read their matrices by draw id
+ *  (see Scene::Material::DRAW_BASE_int) and declare
+ *  "layout(location = 1) in float PaletteIndex;" (unbound, it reads as zero).
+ *
+ */
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+
+struct PaletteBatch {
+	//merge drawables attached to 'root' or its descendants which use 'source_vao' (a vertex array for 'source'):
+	// only triangle drawables that share the first part's material (and have no levels of detail) are merged;
+	// the parts are removed from 'scene' and replaced with one drawable attached to 'root'.
+	// (does nothing if fewer than two parts are found)
+	PaletteBatch(Scene &scene, Scene::Transform *root, MeshBuffer const &source, GLuint source_vao);
+	//frees the buffer (and, through MeshBuffer::forget_buffer, the vertex array):
+	~PaletteBatch();
+
+	PaletteBatch(PaletteBatch const &) = delete;
+	PaletteBatch &operator=(PaletteBatch const &) = delete;
+
+	//parts are indexed with one byte:
+	enum : uint32_t { MaxParts = 256 };
+
+	GLuint buffer = 0; //merged vertex data
+	GLuint vao = 0; //merged vertex data bound for the parts' program
+	Scene::Drawable *drawable = nullptr; //merged drawable, or nullptr if nothing was merged
+};
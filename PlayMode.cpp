@@ -2,38 +2,138 @@
 
 #include "LitColorTextureProgram.hpp"
 
+#include "Animation.hpp"
 #include "DrawLines.hpp"
+#include "RenderStats.hpp"
 #include "Mesh.hpp"
+#include "PaletteBatch.hpp"
+#include "StaticBatch.hpp"
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <fstream>
 #include <random>
+#include <unordered_set>
 
-GLuint hexapod_meshes_for_lit_color_texture_program = 0;
 Load< MeshBuffer > hexapod_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("hexapod.pnct"));
-	hexapod_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
-	return ret;
+	return new MeshBuffer(data_path("hexapod.pnct"));
 });
 
 Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
-	return new Scene(data_path("hexapod.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-		Mesh const &mesh = hexapod_meshes->lookup(mesh_name);
+	auto resolve = [](std::vector< std::string_view > const &mesh_names) {
+		return hexapod_meshes->resolve(mesh_names);
+	};
+	//(vertex arrays are cached by MeshBuffer, so this is the same one PlayMode gets below)
+	GLuint vao = hexapod_meshes->make_vao_for_program(lit_color_texture_program->program);
+	Scene *ret = new Scene(data_path("hexapod.scene"), resolve, [&](Scene &scene, Scene::Transform *transform, MeshBuffer::Handle handle){
+		Mesh const &mesh = hexapod_meshes->get(handle);
 
 		scene.drawables.emplace_back(transform);
 		Scene::Drawable &drawable = scene.drawables.back();
 
 		drawable.pipeline = lit_color_texture_program_pipeline;
 
-		drawable.pipeline.vao = hexapod_meshes_for_lit_color_texture_program;
+		drawable.pipeline.vao = vao;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.position_scale = mesh.position_scale;
+		drawable.pipeline.position_offset = mesh.position_offset;
+
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
+		drawable.sphere_center = mesh.sphere_center;
+		drawable.sphere_radius = mesh.sphere_radius;
+
+		//use lower-detail versions (if exported) as the mesh gets smaller on screen:
+		std::vector< Mesh const * > lods = hexapod_meshes->lookup_lods(handle);
+		if (lods.size() > 1) {
+			drawable.lod_count = uint32_t(std::min< size_t >(lods.size(), Scene::Drawable::MaxLods));
+			for (uint32_t i = 0; i < drawable.lod_count; ++i) {
+				drawable.lods[i].type = lods[i]->type;
+				drawable.lods[i].start = lods[i]->start;
+				drawable.lods[i].count = lods[i]->count;
+				drawable.lods[i].position_scale = lods[i]->position_scale;
+				drawable.lods[i].position_offset = lods[i]->position_offset;
+				//halve the screen size needed for each level (last level is used for anything smaller):
+				drawable.lods[i].min_size = (i + 1 < drawable.lod_count ? 0.25f / float(1 << i) : 0.0f);
+			}
+		}
+
+		//hide things behind this mesh if it has a (simplified) occluder:
+		drawable.occluder = hexapod_meshes->lookup_occluder(handle);
 
 	});
+
+	//everything except the hexapod and the camera (which PlayMode moves) stays put (so PlayMode can bake it into a few merged draws):
+	Scene::Transform *hexapod_root = ret->find_transform("Hip.FL");
+	while (hexapod_root && hexapod_root->parent) hexapod_root = hexapod_root->parent;
+	std::unordered_set< Scene::Transform const * > moved;
+	if (hexapod_root) moved.emplace(hexapod_root);
+	for (auto const &camera : ret->cameras) {
+		moved.emplace(camera.transform);
+	}
+	for (auto &transform : ret->transforms) {
+		transform.is_static = true;
+		for (Scene::Transform const *t = &transform; t != nullptr; t = t->parent) {
+			if (moved.count(t)) {
+				transform.is_static = false;
+				break;
+			}
+		}
+	}
+
+	return ret;
+});
+
+//keyframed motion for the hexapod's transforms:
+Load< Animation > hexapod_animation(LoadTagDefault, []() -> Animation const * {
+	//use exported keyframes, if there are any:
+	if (std::ifstream(data_path("hexapod.anim"), std::ios::binary)) {
+		return new Animation(data_path("hexapod.anim"));
+	}
+
+	//otherwise, bake the front-left leg's wobble into keyframes:
+	Animation *ret = new Animation();
+	constexpr float Period = 10.0f;
+	constexpr uint32_t Keys = 101; //one key every 0.1s, including both ends
+	for (uint32_t k = 0; k < Keys; ++k) {
+		ret->times.emplace_back(Period * float(k) / float(Keys - 1));
+	}
+	ret->duration = Period;
+
+	auto add_wobble = [&](std::string_view name, float degrees, float frequency, glm::vec3 const &axis) {
+		Scene::Transform const *transform = hexapod_scene->find_transform(name);
+		if (!transform) throw std::runtime_error("Transform '" + std::string(name) + "' not found.");
+		Animation::Track track;
+		track.name = transform->name();
+		track.channel = Animation::Track::Rotation;
+		track.times_begin = 0;
+		track.times_end = Keys;
+		track.values_begin = uint32_t(ret->rotations.size());
+		for (uint32_t k = 0; k < Keys; ++k) {
+			float wobble = float(k) / float(Keys - 1);
+			ret->rotations.emplace_back(Animation::QuantizedQuat::from(transform->rotation * glm::angleAxis(
+				glm::radians(degrees * std::sin(wobble * frequency * 2.0f * float(M_PI))),
+				axis
+			)));
+		}
+		ret->tracks.emplace_back(track);
+	};
+	add_wobble("Hip.FL", 5.0f, 1.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	add_wobble("UpperLeg.FL", 7.0f, 2.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+	add_wobble("LowerLeg.FL", 10.0f, 3.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+
+	return ret;
+});
+
+//flattened copy of the scene, so PlayMode instances can spawn it cheaply:
+Load< Scene::Prefab > hexapod_prefab(LoadTagDefault, []() -> Scene::Prefab const * {
+	return new Scene::Prefab(*hexapod_scene);
 });
 
 Load< Sound::Sample > key1(LoadTagDefault, []() -> Sound::Sample const * {
@@ -46,25 +146,66 @@ Load< Sound::Sample > key3(LoadTagDefault, []() -> Sound::Sample const * {
 	return new Sound::Sample(data_path("key3.opus"));
 });
 
-PlayMode::PlayMode() : scene(*hexapod_scene) {
-	//get pointers to leg for convenience:
+PlayMode::PlayMode() {
+	scene.spawn(*hexapod_prefab);
+
+	//bake the static surroundings into a few merged draws:
+	GLuint hexapod_vao = hexapod_meshes->make_vao_for_program(lit_color_texture_program->program);
+	static_batch = std::make_unique< StaticBatch >(scene, *hexapod_meshes, hexapod_vao);
+
+	//draw each remaining top-level model (e.g., the hexapod's body, hips, and legs) with a single call:
 	for (auto &transform : scene.transforms) {
-		if (transform.name == "Hip.FL") hip = &transform;
-		else if (transform.name == "UpperLeg.FL") upper_leg = &transform;
-		else if (transform.name == "LowerLeg.FL") lower_leg = &transform;
+		if (transform.parent != nullptr) continue;
+		auto batch = std::make_unique< PaletteBatch >(scene, &transform, *hexapod_meshes, hexapod_vao);
+		if (batch->drawable) palette_batches.emplace_back(std::move(batch));
 	}
+
+	//get pointers to leg for convenience:
+	hip = scene.find_transform("Hip.FL");
+	upper_leg = scene.find_transform("UpperLeg.FL");
+	lower_leg = scene.find_transform("LowerLeg.FL");
 	if (hip == nullptr) throw std::runtime_error("Hip not found.");
 	if (upper_leg == nullptr) throw std::runtime_error("Upper leg not found.");
 	if (lower_leg == nullptr) throw std::runtime_error("Lower leg not found.");
 
-	hip_base_rotation = hip->rotation;
-	upper_leg_base_rotation = upper_leg->rotation;
-	lower_leg_base_rotation = lower_leg->rotation;
+	hexapod_player.reset(new AnimationPlayer(*hexapod_animation, scene));
 
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
 	camera = &scene.cameras.front();
 
+	//the hexapod scene doesn't have any lamps, so light it from above with a hemisphere light:
+	// (drawn through light_clusters, like any other scene light)
+	if (scene.lights.empty()) {
+		scene.transforms.emplace_back();
+		Scene::Transform *sky = &scene.transforms.back();
+		sky->set_name("Sky");
+		sky->is_static = true;
+		scene.transform_index.emplace(sky->name(), sky);
+		scene.lights.emplace_back(sky);
+		scene.lights.back().type = Scene::Light::Hemisphere;
+		scene.lights.back().energy = glm::vec3(1.0f, 1.0f, 0.95f);
+	}
+
+	//stream copies of the hexapod's surroundings in a ring around the original, as the camera gets near them:
+	streamer.reset(new SceneStreamer(scene));
+	constexpr float RegionSpacing = 100.0f;
+	for (int32_t y = -1; y <= 1; ++y) {
+		for (int32_t x = -1; x <= 1; ++x) {
+			if (x == 0 && y == 0) continue; //(that's the scene spawned above)
+			SceneStreamer::Region region;
+			region.scene_filename = data_path("hexapod.scene");
+			region.meshes_filename = data_path("hexapod.pnct");
+			region.program = lit_color_texture_program->program;
+			region.pipeline = lit_color_texture_program_pipeline;
+			region.position = glm::vec3(float(x), float(y), 0.0f) * RegionSpacing;
+			region.center = region.position;
+			region.load_radius = 0.9f * RegionSpacing;
+			region.unload_radius = 1.1f * RegionSpacing;
+			streamer->add_region(region);
+		}
+	}
+
 	{
 		std::vector<std::pair<std::string, int>> choices;
 		choices.push_back(std::pair<std::string, int>("GO LEFT", 1));
@@ -184,6 +325,12 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 		if (evt.key.keysym.sym == SDLK_ESCAPE) {
 			SDL_SetRelativeMouseMode(SDL_FALSE);
 			return true;
+		} else if (evt.key.keysym.sym == SDLK_F1) {
+			show_render_stats = !show_render_stats;
+			return true;
+		} else if (evt.key.keysym.sym == SDLK_F2) {
+			occlusion_culling = !occlusion_culling;
+			return true;
 		} else if (evt.key.keysym.sym == SDLK_a) {
 			left.downs += 1;
 			left.pressed = true;
@@ -255,22 +402,15 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 
 void PlayMode::update(float elapsed) {
 
-	//slowly rotates through [0,1):
-	wobble += elapsed / 10.0f;
-	wobble -= std::floor(wobble);
-
-	hip->rotation = hip_base_rotation * glm::angleAxis(
-		glm::radians(5.0f * std::sin(wobble * 2.0f * float(M_PI))),
-		glm::vec3(0.0f, 1.0f, 0.0f)
-	);
-	upper_leg->rotation = upper_leg_base_rotation * glm::angleAxis(
-		glm::radians(7.0f * std::sin(wobble * 2.0f * 2.0f * float(M_PI))),
-		glm::vec3(0.0f, 0.0f, 1.0f)
-	);
-	lower_leg->rotation = lower_leg_base_rotation * glm::angleAxis(
-		glm::radians(10.0f * std::sin(wobble * 3.0f * 2.0f * float(M_PI))),
-		glm::vec3(0.0f, 0.0f, 1.0f)
-	);
+	//sample the hexapod's animation into its transforms:
+	hexapod_player->advance(elapsed);
+	hexapod_player->apply();
+
+	//load (or unload) regions near the camera:
+	streamer->update(camera->transform->make_local_to_world()[3]);
+
+	//refit the scene's BVH to the moved leg (and add any streamed-in drawables):
+	scene.update_bvh();
 
 	//move sound to follow leg tip position:
 	/* leg_tip_loop->set_position(get_leg_tip_position(), 1.0f / 60.0f); */
@@ -330,12 +470,15 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
+	//bin the scene's lights into clusters and pass them to lit_color_texture_program:
+	light_clusters.build(scene.lights, *camera, drawable_size);
+	light_clusters.upload();
 	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	glUniform1i(lit_color_texture_program->GLOBAL_LIGHTS_int, GLint(light_clusters.global_lights));
+	glUniform3i(lit_color_texture_program->CLUSTER_GRID_ivec3, GLint(light_clusters.grid.x), GLint(light_clusters.grid.y), GLint(light_clusters.grid.z));
+	glUniform2fv(lit_color_texture_program->CLUSTER_TILE_vec2, 1, glm::value_ptr(light_clusters.tile_size));
+	glUniform1f(lit_color_texture_program->CLUSTER_NEAR_float, light_clusters.near_plane);
+	glUniform1f(lit_color_texture_program->CLUSTER_SLICE_SCALE_float, light_clusters.slice_scale);
 	glUseProgram(0);
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
@@ -344,7 +487,13 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
-	
+
+	light_clusters.bind();
+	glm::mat4 world_to_clip = camera->make_projection() * glm::mat4(camera->transform->make_world_to_local());
+	if (occlusion_culling) scene.render_occluders(world_to_clip, &occlusion);
+	scene.record(world_to_clip, glm::mat4x3(1.0f), &draw_list, occlusion_culling ? &occlusion : nullptr);
+	draw_list.submit();
+	light_clusters.unbind();
 
 	glDisable(GL_DEPTH_TEST);
 	CustomText::draw_text(currentMessage.substr(0, currentMessageIdx + 1).c_str(), glm::vec2(100, 600), 1.0f, glm::vec3(1.0f, 1.0f, 1.0f));
@@ -356,6 +505,11 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 			currentHeight -= 100;
 		}
 	}
+
+	if (show_render_stats) {
+		render_stats.draw_overlay(drawable_size);
+		CustomText::draw_text(occlusion_culling ? "OCCLUSION CULLING ON (F2)" : "OCCLUSION CULLING OFF (F2)", glm::vec2(20, 20), 0.5f, glm::vec3(1.0f, 1.0f, 0.0f));
+	}
 	GL_ERRORS();
 }
 
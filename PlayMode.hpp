@@ -1,11 +1,18 @@
 #include "Mode.hpp"
 
 #include "Scene.hpp"
+#include "Animation.hpp"
+#include "LightClusters.hpp"
+#include "SceneStreamer.hpp"
+#include "OcclusionBuffer.hpp"
+#include "PaletteBatch.hpp"
+#include "StaticBatch.hpp"
 #include "Sound.hpp"
 #include "CustomText.hpp"
 
 #include <glm/glm.hpp>
 
+#include <memory>
 #include <vector>
 #include <deque>
 
@@ -37,17 +44,24 @@ struct PlayMode : Mode {
 		uint8_t pressed = 0;
 	} left, right, down, up;
 
-	//local copy of the game scene (so code can change it during gameplay):
+	//local copy of the game scene, spawned from a prefab (so code can change it during gameplay):
 	Scene scene;
 
-	//hexapod leg to wobble:
+	//merged vertex data for the scene's static surroundings and for the hexapod's parts:
+	std::unique_ptr< StaticBatch > static_batch;
+	std::vector< std::unique_ptr< PaletteBatch > > palette_batches;
+
+	//hexapod leg (moved by the hexapod's animation):
 	Scene::Transform *hip = nullptr;
 	Scene::Transform *upper_leg = nullptr;
 	Scene::Transform *lower_leg = nullptr;
-	glm::quat hip_base_rotation;
-	glm::quat upper_leg_base_rotation;
-	glm::quat lower_leg_base_rotation;
-	float wobble = 0.0f;
+
+	//loads and unloads more copies of the hexapod's surroundings as the camera moves:
+	// (declared after 'scene' so that it is destroyed -- and removes its regions -- first)
+	std::unique_ptr< SceneStreamer > streamer;
+
+	//plays the hexapod's animation on 'scene':
+	std::unique_ptr< AnimationPlayer > hexapod_player;
 
 	glm::vec3 get_leg_tip_position();
 
@@ -57,4 +71,17 @@ struct PlayMode : Mode {
 	//camera:
 	Scene::Camera *camera = nullptr;
 
+	//show render statistics (F1 to toggle)?
+	bool show_render_stats = false;
+
+	//skip drawables hidden behind the scene's occluders? (F2 to toggle; the render statistics show how many were culled):
+	bool occlusion_culling = true;
+	OcclusionBuffer occlusion;
+
+	//reused every frame, so levels of detail change with hysteresis (see Scene::DrawList::lod_levels):
+	Scene::DrawList draw_list;
+
+	//scene lights, binned for drawing:
+	LightClusters light_clusters;
+
 };
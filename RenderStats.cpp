@@ -0,0 +1,46 @@
+#include "RenderStats.hpp"
+
+#include "DrawLines.hpp"
+
+RenderStats render_stats;
+
+std::string RenderStats::Counters::to_string() const {
+	std::string ret;
+	ret += "draws: " + std::to_string(draw_calls) + "\n";
+	ret += "vertices: " + std::to_string(vertices) + "\n";
+	ret += "program binds: " + std::to_string(program_binds) + "\n";
+	ret += "vao binds: " + std::to_string(vao_binds) + "\n";
+	ret += "texture binds: " + std::to_string(texture_binds) + "\n";
+	ret += "uploaded: " + std::to_string(bytes_uploaded / 1024) + " kb\n";
+	ret += "objects: " + std::to_string(objects_drawn) + " drawn, " + std::to_string(objects_culled) + " culled\n";
+	return ret;
+}
+
+void RenderStats::next_frame() {
+	last = current;
+	current = Counters();
+}
+
+void RenderStats::draw_overlay(glm::uvec2 const &drawable_size) const {
+	float aspect = float(drawable_size.x) / float(drawable_size.y);
+	DrawLines lines(glm::mat4(
+		1.0f / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	));
+
+	constexpr float H = 0.05f;
+	glm::vec3 anchor = glm::vec3(-aspect + 0.5f * H, 1.0f - 1.5f * H, 0.0f);
+	std::string text = last.to_string();
+	for (size_t begin = 0; begin < text.size(); /* later */) {
+		size_t end = text.find('\n', begin);
+		if (end == std::string::npos) end = text.size();
+		lines.draw_text(text.substr(begin, end - begin),
+			anchor,
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+		anchor.y -= 1.2f * H;
+		begin = end + 1;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * RenderStats counts the work the renderer submits each frame -- draw calls,
+ *  vertices, state changes, buffer uploads, and culling results -- so that
+ *  changes in submission cost show up without an external profiler.
+ *
+ * Scene, DrawLines, and CustomText add to 'render_stats.current' as they
+ *  issue GL commands (as do MeshBuffer, LightClusters, PaletteBatch, and
+ *  StaticBatch when they upload data); main.cpp calls render_stats.next_frame() once per
+ *  frame, which moves those counts into 'render_stats.last'.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+
+struct RenderStats {
+	struct Counters {
+		uint32_t draw_calls = 0;
+		uint64_t vertices = 0; //vertices submitted (count times instances, summed over draw calls)
+		uint32_t program_binds = 0;
+		uint32_t vao_binds = 0;
+		uint32_t texture_binds = 0;
+		uint64_t bytes_uploaded = 0; //bytes passed to glBufferData / glBufferSubData
+		uint32_t objects_drawn = 0; //drawables that passed culling
+		uint32_t objects_culled = 0; //drawables rejected by frustum or occlusion culling
+
+		//one line per counter:
+		std::string to_string() const;
+	};
+
+	Counters current; //frame being drawn
+	Counters last; //most recently finished frame
+
+	//start counting a new frame:
+	void next_frame();
+
+	//draw 'last' as text in the upper left corner of the screen (using DrawLines):
+	// (this adds to 'current' like any other drawing)
+	void draw_overlay(glm::uvec2 const &drawable_size) const;
+};
+
+extern RenderStats render_stats;
@@ -2,13 +2,33 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "Load.hpp"
+#include "MappedFile.hpp"
+#include "OcclusionBuffer.hpp"
+#include "DepthProgram.hpp"
+#include "RenderStats.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <deque>
+#include <unordered_set>
+#include <mutex>
 
 //-------------------------
 
+void Scene::Transform::set_name(std::string_view name) {
+	name_ = Scene::intern(name);
+}
+
+bool Scene::Transform::never_moves() const {
+	for (Transform const *t = this; t != nullptr; t = t->parent) {
+		if (!t->is_static) return false;
+	}
+	return true;
+}
+
 glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	//compute:
 	//   translate   *   rotate    *   scale
@@ -73,6 +93,26 @@ glm::mat4x3 Scene::Transform::make_world_to_local() const {
 
 //-------------------------
 
+Scene::ObjectMatrices::ObjectMatrices(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, glm::mat4x3 const &object_to_world, glm::vec3 const &position_scale, glm::vec3 const &position_offset) {
+	glm::mat4 decode = glm::mat4(
+		glm::vec4(position_scale.x, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, position_scale.y, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, position_scale.z, 0.0f),
+		glm::vec4(position_offset, 1.0f)
+	);
+	OBJECT_TO_CLIP = world_to_clip * glm::mat4(object_to_world) * decode;
+	glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+	OBJECT_TO_LIGHT_rows = glm::transpose(glm::mat4x3(glm::mat4(object_to_light) * decode));
+	glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+	NORMAL_TO_LIGHT = glm::mat3x4(
+		glm::vec4(normal_to_light[0], 0.0f),
+		glm::vec4(normal_to_light[1], 0.0f),
+		glm::vec4(normal_to_light[2], 0.0f)
+	);
+}
+
+//-------------------------
+
 glm::mat4 Scene::Camera::make_projection() const {
 	return glm::infinitePerspective( fovy, aspect, near );
 }
@@ -80,83 +120,379 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
-void Scene::draw(Camera const &camera) const {
+void Scene::draw(Camera const &camera, bool depth_prepass) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(world_to_clip, world_to_light);
+	draw(world_to_clip, world_to_light, depth_prepass);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+//Object matrices for every drawable that reads them by draw id are uploaded once per frame
+// into this buffer, which programs sample through a buffer texture:
+//n.b. declared static so they don't conflict with similarly named global variables elsewhere:
+static GLuint object_matrices_buffer = 0;
+static GLuint object_matrices_texture = 0;
+
+static Load< void > setup_object_matrices(LoadTagEarly, [](){
+	glGenBuffers(1, &object_matrices_buffer);
+	//(buffer is re-filled every time a scene is drawn)
+
+	glGenTextures(1, &object_matrices_texture);
+	glBindTexture(GL_TEXTURE_BUFFER, object_matrices_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, object_matrices_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
+});
+
+//a drawable that is going to be recorded, along with the pipeline state (after LOD selection) it will be drawn with:
+namespace {
+	struct ToDraw {
+		Scene::Drawable const *drawable;
+		Scene::Drawable::Pipeline pipeline;
+		glm::mat4x3 object_to_world;
+	};
+}
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+//drawables may be drawn as instances of each other if they share all pipeline state:
+static bool instance_order(ToDraw const &a, ToDraw const &b) {
+	Scene::Drawable::Pipeline const &pa = a.pipeline;
+	Scene::Drawable::Pipeline const &pb = b.pipeline;
+	if (pa.material != pb.material) return pa.material < pb.material;
+	if (pa.vao != pb.vao) return pa.vao < pb.vao;
+	if (pa.type != pb.type) return pa.type < pb.type;
+	if (pa.index_type != pb.index_type) return pa.index_type < pb.index_type;
+	if (pa.start != pb.start) return pa.start < pb.start;
+	return pa.count < pb.count;
+}
+
+static bool same_instance(ToDraw const &a, ToDraw const &b) {
+	return !instance_order(a, b) && !instance_order(b, a);
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, bool depth_prepass) const {
+	DrawList list;
+	record(world_to_clip, world_to_light, &list);
+	list.submit(depth_prepass);
+}
+
+void Scene::record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, DrawList *list_, OcclusionBuffer const *occlusion) const {
+	assert(list_);
+	auto &list = *list_;
+	list.clear();
+
+	//levels of detail from the last time this list was recorded (only levels used this time are kept):
+	std::unordered_map< Drawable const *, uint32_t > previous_lod_levels;
+	previous_lod_levels.swap(list.lod_levels);
+
+	//Find drawables that might be in view:
+	std::vector< Drawable const * > visible;
+	gather_visible(world_to_clip, &visible, occlusion);
+	list.objects_drawn = uint32_t(visible.size());
+	list.objects_culled = uint32_t(drawables.size() - visible.size());
+
+	//clip-space size of a unit world-space length at w == 1 (exact for a rigid view and symmetric projection):
+	float clip_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+
+	//Split drawables into those that read their matrices by draw id (and so can be instanced),
+	// those with a matrix palette (which also read matrices by draw id, but one per palette entry),
+	// and those that use per-draw uniforms:
+	std::vector< ToDraw > instanced;
+	std::vector< ToDraw > palettized;
+	std::vector< ToDraw > single;
+	for (Drawable const *drawable : visible) {
+		Material const &material = get_material(drawable->pipeline.material);
 
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (material.program == 0) continue;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		if (drawable->pipeline.vao == 0) continue;
+
+		assert(drawable->transform); //drawables *must* have a transform
+		ToDraw to_draw{drawable, drawable->pipeline, drawable->transform->make_local_to_world()};
+
+		//pick level of detail:
+		if (drawable->lod_count > 0 && !BVH::AABB(drawable->min, drawable->max).empty()) {
+			assert(drawable->lod_count <= Drawable::MaxLods);
+			//bounding sphere in world space (the drawable's own, if it has one; otherwise, the one around its box):
+			glm::mat4x3 const &xf = to_draw.object_to_world;
+			bool has_sphere = (drawable->sphere_radius >= 0.0f);
+			glm::vec3 center = xf * glm::vec4(has_sphere ? drawable->sphere_center : 0.5f * (drawable->min + drawable->max), 1.0f);
+			float scale = std::max(glm::length(xf[0]), std::max(glm::length(xf[1]), glm::length(xf[2])));
+			float radius = (has_sphere ? drawable->sphere_radius : 0.5f * glm::length(drawable->max - drawable->min)) * scale;
+
+			//fraction of the screen height covered by the sphere:
+			float w = (world_to_clip * glm::vec4(center, 1.0f)).w;
+			float size = (w > radius ? radius * clip_scale / w : std::numeric_limits< float >::infinity());
+
+			//move from the level this view last used toward the right level, but only past thresholds by more than the hysteresis margin:
+			auto f = previous_lod_levels.find(drawable);
+			float margin = (f != previous_lod_levels.end() ? lod_hysteresis : 0.0f);
+			uint32_t lod = (f != previous_lod_levels.end() ? std::min(f->second, drawable->lod_count - 1) : 0);
+			while (lod > 0 && size >= drawable->lods[lod-1].min_size * (1.0f + margin)) --lod;
+			while (lod + 1 < drawable->lod_count && size < drawable->lods[lod].min_size * (1.0f - margin)) ++lod;
+			list.lod_levels.emplace(drawable, lod);
+
+			to_draw.pipeline.type = drawable->lods[lod].type;
+			to_draw.pipeline.start = drawable->lods[lod].start;
+			to_draw.pipeline.count = drawable->lods[lod].count;
+			to_draw.pipeline.position_scale = drawable->lods[lod].position_scale;
+			to_draw.pipeline.position_offset = drawable->lods[lod].position_offset;
+		}
+
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		if (to_draw.pipeline.count == 0) continue;
+
+		if (drawable->palette_count != 0) {
+			assert(material.DRAW_BASE_int != -1U && "palette drawables must read matrices by draw id");
+			if (material.DRAW_BASE_int == -1U) continue;
+			palettized.emplace_back(to_draw);
+		} else if (material.DRAW_BASE_int != -1U) {
+			instanced.emplace_back(to_draw);
+		} else {
+			single.emplace_back(to_draw);
+		}
+	}
+
+	//sort so that drawables that can be instances of each other are adjacent:
+	std::sort(instanced.begin(), instanced.end(), instance_order);
+
+	//compute every drawable's matrices, in the order they will be drawn (so draw id == index):
+	list.matrices.reserve(instanced.size() + single.size());
+	for (ToDraw const &to_draw : instanced) {
+		list.matrices.emplace_back(world_to_clip, world_to_light, to_draw.object_to_world, to_draw.pipeline.position_scale, to_draw.pipeline.position_offset);
+	}
+	std::vector< uint32_t > palette_bases;
+	palette_bases.reserve(palettized.size());
+	for (ToDraw const &to_draw : palettized) {
+		palette_bases.emplace_back(uint32_t(list.matrices.size()));
+		Drawable const &drawable = *to_draw.drawable;
+		assert(drawable.palette_begin + drawable.palette_count <= palette.size());
+		for (uint32_t p = drawable.palette_begin; p < drawable.palette_begin + drawable.palette_count; ++p) {
+			list.matrices.emplace_back(world_to_clip, world_to_light, palette[p].transform->make_local_to_world(), to_draw.pipeline.position_scale, to_draw.pipeline.position_offset);
+		}
+	}
+	uint32_t single_base = uint32_t(list.matrices.size());
+	for (ToDraw const &to_draw : single) {
+		list.matrices.emplace_back(world_to_clip, world_to_light, to_draw.object_to_world, to_draw.pipeline.position_scale, to_draw.pipeline.position_offset);
+	}
 
+	auto add_command = [&list](Scene::Drawable::Pipeline const &pipeline, uint32_t draw_id, uint32_t instances) {
+		list.commands.emplace_back();
+		DrawList::Command &command = list.commands.back();
+		command.material = pipeline.material;
+		command.vao = pipeline.vao;
+		command.type = pipeline.type;
+		command.start = pipeline.start;
+		command.count = pipeline.count;
+		command.index_type = pipeline.index_type;
+		command.instances = instances;
+		command.draw_id = draw_id;
+	};
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+	//one instanced command per run of drawables sharing all pipeline state:
+	for (size_t begin = 0; begin < instanced.size(); /* later */) {
+		size_t end = begin + 1;
+		while (end < instanced.size() && same_instance(instanced[begin], instanced[end])) ++end;
+		add_command(instanced[begin].pipeline, uint32_t(begin), uint32_t(end - begin));
+		begin = end;
+	}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+	//one command for each palette drawable (palette entry i is at draw id base + i):
+	for (size_t i = 0; i < palettized.size(); ++i) {
+		add_command(palettized[i].pipeline, palette_bases[i], 1);
+	}
 
-		//Configure program uniforms:
+	//one command for each remaining drawable:
+	for (size_t i = 0; i < single.size(); ++i) {
+		add_command(single[i].pipeline, single_base + uint32_t(i), 1);
+	}
+}
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+//-------------------------
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
-		}
+void Scene::DrawList::clear() {
+	commands.clear();
+	matrices.clear();
+	objects_drawn = 0;
+	objects_culled = 0;
+}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+//set program, constant uniforms, and textures for a material:
+static void bind_material(Scene::Material const &material) {
+	glUseProgram(material.program);
+	render_stats.current.program_binds += 1;
+
+	for (auto const &uniform : material.uniforms) {
+		if (uniform.location == -1U) continue;
+		if (uniform.type == Scene::Material::UniformValue::Int) glUniform1iv(uniform.location, 1, uniform.i);
+		else if (uniform.type == Scene::Material::UniformValue::Float) glUniform1fv(uniform.location, 1, uniform.f);
+		else if (uniform.type == Scene::Material::UniformValue::Vec2) glUniform2fv(uniform.location, 1, uniform.f);
+		else if (uniform.type == Scene::Material::UniformValue::Vec3) glUniform3fv(uniform.location, 1, uniform.f);
+		else if (uniform.type == Scene::Material::UniformValue::Vec4) glUniform4fv(uniform.location, 1, uniform.f);
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	for (uint32_t i = 0; i < Scene::Material::TextureCount; ++i) {
+		if (material.textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(material.textures[i].target, material.textures[i].texture);
+			render_stats.current.texture_binds += 1;
 		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+//issue the draw call for a command (with or without indices; instanced or not):
+static void draw_command(Scene::DrawList::Command const &command, bool instanced) {
+	if (command.index_type != GL_NONE) {
+		GLsizeiptr index_size = (command.index_type == GL_UNSIGNED_INT ? 4 : command.index_type == GL_UNSIGNED_SHORT ? 2 : 1);
+		void const *offset = (GLbyte *)0 + command.start * index_size;
+		if (instanced) glDrawElementsInstanced(command.type, command.count, command.index_type, offset, GLsizei(command.instances));
+		else glDrawElements(command.type, command.count, command.index_type, offset);
+	} else {
+		if (instanced) glDrawArraysInstanced(command.type, command.start, command.count, GLsizei(command.instances));
+		else glDrawArrays(command.type, command.start, command.count);
+	}
+	render_stats.current.draw_calls += 1;
+	render_stats.current.vertices += uint64_t(command.count) * command.instances;
+}
+
+static void unbind_material(Scene::Material const &material) {
+	for (uint32_t i = 0; i < Scene::Material::TextureCount; ++i) {
+		if (material.textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(material.textures[i].target, 0);
 		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+void Scene::DrawList::submit(bool depth_prepass) const {
+	//(counted here rather than in record(), which may run on other threads)
+	render_stats.current.objects_drawn += objects_drawn;
+	render_stats.current.objects_culled += objects_culled;
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+	if (commands.empty()) return;
+
+	//upload the matrices all at once, if any command reads them by draw id (the depth pre-pass always does):
+	bool uses_draw_ids = false;
+	bool uses_prepass = false;
+	for (auto const &command : commands) {
+		Material const &material = get_material(command.material);
+		if (material.DRAW_BASE_int != -1U) uses_draw_ids = true;
+		if (depth_prepass && material.depth_prepass) uses_prepass = true;
+	}
+	if (uses_draw_ids || uses_prepass) {
+		glBindBuffer(GL_TEXTURE_BUFFER, object_matrices_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, matrices.size() * sizeof(ObjectMatrices), matrices.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		render_stats.current.bytes_uploaded += matrices.size() * sizeof(ObjectMatrices);
+
+		glActiveTexture(GL_TEXTURE0 + ObjectMatricesTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, object_matrices_texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	GLuint current_vao = 0;
+
+	//caller's depth state, used for drawables that aren't in the pre-pass (and restored at the end):
+	GLint depth_func = GL_LESS;
+	GLboolean depth_mask = GL_TRUE;
+	if (uses_prepass) {
+		glGetIntegerv(GL_DEPTH_FUNC, &depth_func);
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &depth_mask);
+
+		//depth-only pass over every drawable that allows it:
+		glUseProgram(depth_program->program);
+		render_stats.current.program_binds += 1;
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_TRUE);
+		for (auto const &command : commands) {
+			if (!get_material(command.material).depth_prepass) continue;
+			if (command.vao != current_vao) {
+				current_vao = command.vao;
+				glBindVertexArray(command.vao);
+				render_stats.current.vao_binds += 1;
+			}
+			glUniform1i(depth_program->DRAW_BASE_int, GLint(command.draw_id));
+			draw_command(command, true);
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+	bool depth_equal = false; //is the color pass currently testing against the pre-pass's depth?
+
+	Material const *current_material = nullptr;
+	for (auto const &command : commands) {
+		assert(command.draw_id + command.instances <= matrices.size());
+		Material const &material = get_material(command.material);
+
+		//Set program, uniforms, textures, and attribute sources (if they changed):
+		if (&material != current_material) {
+			if (current_material) unbind_material(*current_material);
+			current_material = &material;
+			bind_material(material);
+
+			//shade only the surfaces the pre-pass found to be nearest:
+			if (uses_prepass && material.depth_prepass != depth_equal) {
+				depth_equal = material.depth_prepass;
+				glDepthFunc(depth_equal ? GL_EQUAL : GLenum(depth_func));
+				glDepthMask(depth_equal ? GL_FALSE : depth_mask);
 			}
 		}
+		if (command.vao != current_vao) {
+			current_vao = command.vao;
+			glBindVertexArray(command.vao);
+			render_stats.current.vao_binds += 1;
+		}
+
+		//Configure per-draw uniforms:
+		if (material.DRAW_BASE_int != -1U) {
+			//instance i reads matrices for draw id DRAW_BASE + i:
+			glUniform1i(material.DRAW_BASE_int, GLint(command.draw_id));
+		} else {
+			ObjectMatrices const &m = matrices[command.draw_id];
+
+			//OBJECT_TO_CLIP takes vertices from object space to clip space:
+			if (material.OBJECT_TO_CLIP_mat4 != -1U) {
+				glUniformMatrix4fv(material.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(m.OBJECT_TO_CLIP));
+			}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+			//OBJECT_TO_LIGHT takes vertices from object space to light space:
+			if (material.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				glm::mat4x3 object_to_light = glm::transpose(m.OBJECT_TO_LIGHT_rows);
+				glUniformMatrix4x3fv(material.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+			}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+			//NORMAL_TO_LIGHT takes normals from object space to light space:
+			if (material.NORMAL_TO_LIGHT_mat3 != -1U) {
+				glm::mat3 normal_to_light = glm::mat3(
+					glm::vec3(m.NORMAL_TO_LIGHT[0]),
+					glm::vec3(m.NORMAL_TO_LIGHT[1]),
+					glm::vec3(m.NORMAL_TO_LIGHT[2])
+				);
+				glUniformMatrix3fv(material.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
 			}
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		//draw the object(s):
+		if (material.DRAW_BASE_int != -1U) {
+			draw_command(command, true);
+		} else {
+			assert(command.instances == 1);
+			draw_command(command, false);
+		}
+	}
+	if (current_material) unbind_material(*current_material);
+
+	if (depth_equal) {
+		glDepthFunc(GLenum(depth_func));
+		glDepthMask(depth_mask);
+	}
+
+	if (uses_draw_ids || uses_prepass) {
+		glActiveTexture(GL_TEXTURE0 + ObjectMatricesTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0);
 	}
 
 	glUseProgram(0);
@@ -165,14 +501,255 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 	GL_ERRORS();
 }
 
+//-------------------------
+
+//n.b. a deque, so references returned by get_material stay valid as materials are added:
+static std::deque< Scene::Material > &material_registry() {
+	static std::deque< Scene::Material > registry(1); //index 0 is the empty material
+	return registry;
+}
+
+uint32_t Scene::register_material(Material const &material) {
+	auto &registry = material_registry();
+	registry.emplace_back(material);
+	return uint32_t(registry.size() - 1);
+}
+
+Scene::Material const &Scene::get_material(uint32_t index) {
+	auto &registry = material_registry();
+	assert(index < registry.size());
+	return registry[index];
+}
+
+//helper for the Material::set_uniform() functions:
+static Scene::Material::UniformValue *next_free_uniform(Scene::Material &material) {
+	for (auto &uniform : material.uniforms) {
+		if (uniform.location == -1U) return &uniform;
+	}
+	throw std::runtime_error("Material already has " + std::to_string(Scene::Material::UniformCount) + " uniform values set.");
+}
+
+void Scene::Material::set_uniform(GLuint location, int32_t value) {
+	if (location == -1U) return;
+	UniformValue *uniform = next_free_uniform(*this);
+	uniform->location = location;
+	uniform->type = UniformValue::Int;
+	uniform->i[0] = value;
+}
+
+void Scene::Material::set_uniform(GLuint location, float value) {
+	if (location == -1U) return;
+	UniformValue *uniform = next_free_uniform(*this);
+	uniform->location = location;
+	uniform->type = UniformValue::Float;
+	uniform->f[0] = value;
+}
+
+void Scene::Material::set_uniform(GLuint location, glm::vec2 const &value) {
+	if (location == -1U) return;
+	UniformValue *uniform = next_free_uniform(*this);
+	uniform->location = location;
+	uniform->type = UniformValue::Vec2;
+	uniform->f[0] = value.x;
+	uniform->f[1] = value.y;
+}
+
+void Scene::Material::set_uniform(GLuint location, glm::vec3 const &value) {
+	if (location == -1U) return;
+	UniformValue *uniform = next_free_uniform(*this);
+	uniform->location = location;
+	uniform->type = UniformValue::Vec3;
+	uniform->f[0] = value.x;
+	uniform->f[1] = value.y;
+	uniform->f[2] = value.z;
+}
+
+void Scene::Material::set_uniform(GLuint location, glm::vec4 const &value) {
+	if (location == -1U) return;
+	UniformValue *uniform = next_free_uniform(*this);
+	uniform->location = location;
+	uniform->type = UniformValue::Vec4;
+	uniform->f[0] = value.x;
+	uniform->f[1] = value.y;
+	uniform->f[2] = value.z;
+	uniform->f[3] = value.w;
+}
+
+//-------------------------
+
+//box (in the space 'xf' maps to) around a palette part; tighter than its transformed box alone when the part has a bounding sphere:
+static BVH::AABB palette_part_bounds(Scene::PalettePart const &part, glm::mat4x3 const &xf) {
+	BVH::AABB bounds = BVH::AABB(part.min, part.max).transformed(xf);
+	if (part.sphere_radius >= 0.0f && !bounds.empty()) {
+		//(scaled by the largest axis scale, so the sphere still contains the part under non-uniform scaling)
+		glm::vec3 center = xf * glm::vec4(part.sphere_center, 1.0f);
+		float radius = part.sphere_radius * std::max(glm::length(xf[0]), std::max(glm::length(xf[1]), glm::length(xf[2])));
+		bounds.min = glm::max(bounds.min, center - glm::vec3(radius));
+		bounds.max = glm::min(bounds.max, center + glm::vec3(radius));
+	}
+	return bounds;
+}
+
+void Scene::update_bvh() {
+	for (auto &drawable : drawables) {
+		//static drawables only need to be inserted once:
+		if (drawable.bvh_leaf != -1U && drawable.palette_count == 0 && drawable.transform->never_moves()) continue;
+
+		//palette drawables are bounded by their parts, which may have moved:
+		if (drawable.palette_count != 0) {
+			assert(drawable.palette_begin + drawable.palette_count <= palette.size());
+			BVH::AABB world_bounds;
+			BVH::AABB root_bounds;
+			glm::mat4 world_to_root = glm::mat4(drawable.transform->make_world_to_local());
+			for (uint32_t p = drawable.palette_begin; p < drawable.palette_begin + drawable.palette_count; ++p) {
+				if (BVH::AABB(palette[p].min, palette[p].max).empty()) continue;
+				glm::mat4x3 part_to_world = palette[p].transform->make_local_to_world();
+				world_bounds = BVH::AABB::merge(world_bounds, palette_part_bounds(palette[p], part_to_world));
+				root_bounds = BVH::AABB::merge(root_bounds, palette_part_bounds(palette[p], glm::mat4x3(world_to_root * glm::mat4(part_to_world))));
+			}
+			drawable.min = root_bounds.min;
+			drawable.max = root_bounds.max;
+			if (world_bounds.empty()) {
+				if (drawable.bvh_leaf != -1U) {
+					bvh.remove(drawable.bvh_leaf);
+					drawable.bvh_leaf = -1U;
+				}
+			} else if (drawable.bvh_leaf == -1U) {
+				drawable.bvh_leaf = bvh.insert(world_bounds, &drawable);
+			} else {
+				bvh.move(drawable.bvh_leaf, world_bounds);
+			}
+			continue;
+		}
+
+		BVH::AABB bounds(drawable.min, drawable.max);
+		if (bounds.empty()) {
+			//drawables without bounds aren't tracked:
+			if (drawable.bvh_leaf != -1U) {
+				bvh.remove(drawable.bvh_leaf);
+				drawable.bvh_leaf = -1U;
+			}
+			continue;
+		}
+		assert(drawable.transform);
+		BVH::AABB world_bounds = bounds.transformed(drawable.transform->make_local_to_world());
+		if (drawable.bvh_leaf == -1U) {
+			drawable.bvh_leaf = bvh.insert(world_bounds, &drawable);
+		} else {
+			bvh.move(drawable.bvh_leaf, world_bounds);
+		}
+	}
+}
+
+void Scene::gather_visible(glm::mat4 const &world_to_clip, std::vector< Drawable const * > *visible_, OcclusionBuffer const *occlusion) const {
+	assert(visible_);
+	auto &visible = *visible_;
+	visible.clear();
+
+	//drawables without bounds are always drawn:
+	// (scenes that don't use bounds at all skip the BVH entirely)
+	for (auto const &drawable : drawables) {
+		if (drawable.bvh_leaf == -1U) visible.emplace_back(&drawable);
+	}
+
+	bvh.query_frustum(world_to_clip, [&visible, occlusion](void *data) {
+		Drawable const *drawable = static_cast< Drawable const * >(data);
+		if (occlusion) {
+			//test the drawable's actual (non-fat) world bounds against the occluders:
+			BVH::AABB world_bounds = BVH::AABB(drawable->min, drawable->max).transformed(drawable->transform->make_local_to_world());
+			if (!occlusion->visible(world_bounds)) return true;
+		}
+		visible.emplace_back(drawable);
+		return true;
+	});
+}
+
+void Scene::render_occluders(glm::mat4 const &world_to_clip, OcclusionBuffer *occlusion_) const {
+	assert(occlusion_);
+	auto &occlusion = *occlusion_;
+	occlusion.begin(world_to_clip);
+
+	//occluders of drawables without bounds can't be frustum culled, so just add them:
+	for (auto const &drawable : drawables) {
+		if (drawable.occluder && drawable.bvh_leaf == -1U) {
+			occlusion.add_occluder(drawable.transform->make_local_to_world(), *drawable.occluder);
+		}
+	}
+
+	bvh.query_frustum(world_to_clip, [&occlusion](void *data) {
+		Drawable const *drawable = static_cast< Drawable const * >(data);
+		if (drawable->occluder) {
+			occlusion.add_occluder(drawable->transform->make_local_to_world(), *drawable->occluder);
+		}
+		return true;
+	});
+
+	occlusion.finish();
+}
+
+Scene::Drawable *Scene::pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance) const {
+	glm::vec3 inv_dir = glm::vec3(1.0f) / direction;
+
+	Drawable *closest = nullptr;
+	float closest_t = std::numeric_limits< float >::infinity();
+	bvh.query_ray(origin, direction, closest_t, [&](void *data, float) {
+		Drawable *drawable = static_cast< Drawable * >(data);
+		//refine with the drawable's actual (non-fat) world bounds:
+		BVH::AABB world_bounds = BVH::AABB(drawable->min, drawable->max).transformed(drawable->transform->make_local_to_world());
+		float t = world_bounds.ray_hit(origin, inv_dir, closest_t);
+		if (t < closest_t) {
+			closest = drawable;
+			closest_t = t;
+		}
+		return closest_t;
+	});
+
+	if (distance) *distance = closest_t;
+	return closest;
+}
+
+void Scene::overlapping(BVH::AABB const &box, std::vector< Drawable * > *found_) const {
+	assert(found_);
+	auto &found = *found_;
+	found.clear();
+	bvh.query_box(box, [&](void *data) {
+		Drawable *drawable = static_cast< Drawable * >(data);
+		BVH::AABB world_bounds = BVH::AABB(drawable->min, drawable->max).transformed(drawable->transform->make_local_to_world());
+		if (world_bounds.overlaps(box)) found.emplace_back(drawable);
+		return true;
+	});
+}
+
+//-------------------------
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	//"resolve" each name to its position in the list, and look it up again for each drawable:
+	std::vector< std::string_view > mesh_names;
+	load(filename, [&mesh_names](std::vector< std::string_view > const &names) {
+		mesh_names = names;
+		std::vector< uint32_t > ids(names.size());
+		for (uint32_t i = 0; i < ids.size(); ++i) ids[i] = i;
+		return ids;
+	}, [&mesh_names, &on_drawable](Scene &scene, Transform *transform, uint32_t id) {
+		if (on_drawable) on_drawable(scene, transform, std::string(mesh_names[id]));
+	});
+}
+
+void Scene::load(std::string const &filename,
+	std::function< std::vector< uint32_t >(std::vector< std::string_view > const &) > const &resolve_meshes,
+	std::function< void(Scene &, Transform *, uint32_t) > const &on_drawable) {
+
+	//map the file and read chunks in place (no copies or per-chunk allocations):
+	MappedFile file(filename);
+	char const *at = file.data;
+	char const *end = file.data + file.size;
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkView< char > names;
+	read_chunk(&at, end, "str0", &names);
+	//transform names will refer to a (single) interned copy of the string table:
+	std::string_view interned_names = intern(std::string_view(names.data(), names.size()));
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +760,8 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkView< HierarchyEntry > hierarchy;
+	read_chunk(&at, end, "xfh0", &hierarchy);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +769,8 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkView< MeshEntry > meshes;
+	read_chunk(&at, end, "msh0", &meshes);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +779,8 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
+	ChunkView< CameraEntry > loaded_cameras;
+	read_chunk(&at, end, "cam0", &loaded_cameras);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +791,8 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+	ChunkView< LightEntry > loaded_lights;
+	read_chunk(&at, end, "lmp0", &loaded_lights);
 
 
 	//--------------------------------
@@ -235,7 +812,8 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name_ = interned_names.substr(h.name_begin, h.name_end - h.name_begin);
+			transform_index.emplace(t->name_, t);
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -248,19 +826,34 @@ void Scene::load(std::string const &filename,
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
-	for (auto const &m : meshes) {
-		if (m.transform >= hierarchy_transforms.size()) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
-		}
-		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
+	{ //resolve the mesh table, then make drawables:
+		//distinct names (by content, since exporters may store the same name more than once), and each entry's name:
+		std::vector< std::string_view > mesh_names;
+		std::vector< uint32_t > entry_names;
+		entry_names.reserve(meshes.size());
+		std::unordered_map< std::string_view, uint32_t > name_ids;
+		for (auto const &m : meshes) {
+			if (m.transform >= hierarchy_transforms.size()) {
+				throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+			}
+			if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+				throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
+			}
+			std::string_view name = interned_names.substr(m.name_begin, m.name_end - m.name_begin);
+			auto f = name_ids.emplace(name, uint32_t(mesh_names.size()));
+			if (f.second) mesh_names.emplace_back(name);
+			entry_names.emplace_back(f.first->second);
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
 
 		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
+			std::vector< uint32_t > ids = (resolve_meshes ? resolve_meshes(mesh_names) : std::vector< uint32_t >());
+			if (ids.size() != mesh_names.size()) {
+				throw std::runtime_error("resolving meshes in scene file '" + filename + "' gave " + std::to_string(ids.size()) + " ids for " + std::to_string(mesh_names.size()) + " names");
+			}
+			for (uint32_t i = 0; i < meshes.size(); ++i) {
+				on_drawable(*this, hierarchy_transforms[meshes[i].transform], ids[entry_names[i]]);
+			}
 		}
-
 	}
 
 	for (auto const &c : loaded_cameras) {
@@ -301,10 +894,15 @@ void Scene::load(std::string const &filename,
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 	}
 
-	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	//load any extra that a subclass wants (reading the rest of the mapped file as a stream):
+	MemoryStreambuf rest(at, end);
+	std::istream extra(&rest);
+	load_extra(extra, interned_names, hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	//track any drawables that the on_drawable callback gave bounds:
+	update_bvh();
+
+	if (extra.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -318,6 +916,12 @@ Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform
 	load(filename, on_drawable);
 }
 
+Scene::Scene(std::string const &filename,
+	std::function< std::vector< uint32_t >(std::vector< std::string_view > const &) > const &resolve_meshes,
+	std::function< void(Scene &, Transform *, uint32_t) > const &on_drawable) {
+	load(filename, resolve_meshes, on_drawable);
+}
+
 Scene::Scene(Scene const &other) {
 	set(other);
 }
@@ -341,11 +945,12 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	transforms.clear();
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
-		transforms.back().name = t.name;
+		transforms.back().name_ = t.name_;
 		transforms.back().position = t.position;
 		transforms.back().rotation = t.rotation;
 		transforms.back().scale = t.scale;
 		transforms.back().parent = t.parent; //will update later
+		transforms.back().is_static = t.is_static;
 
 		//store mapping between transforms old and new:
 		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
@@ -357,11 +962,23 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		t.parent = transform_to_transform.at(t.parent);
 	}
 
+	index_transforms();
+
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
 		d.transform = transform_to_transform.at(d.transform);
+		d.bvh_leaf = -1U; //(leaf ids refer to other.bvh)
 	}
+	palette = other.palette;
+	for (auto &part : palette) {
+		part.transform = transform_to_transform.at(part.transform);
+	}
+
+	//rebuild the BVH over the copied drawables:
+	bvh.clear();
+	bvh.margin = other.bvh.margin;
+	update_bvh();
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
@@ -375,3 +992,241 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		l.transform = transform_to_transform.at(l.transform);
 	}
 }
+
+//-------------------------
+
+Scene::Prefab::Prefab(Scene const &scene) {
+	//map transform pointers to indices (done once, here, so spawn() doesn't have to):
+	std::unordered_map< Transform const *, uint32_t > transform_index;
+	transform_index.reserve(scene.transforms.size());
+	for (auto const &t : scene.transforms) {
+		transform_index.emplace(&t, uint32_t(transforms.size()));
+		transforms.emplace_back();
+		transforms.back().position = t.position;
+		transforms.back().rotation = t.rotation;
+		transforms.back().scale = t.scale;
+		transforms.back().is_static = t.is_static;
+		names.emplace_back(t.name_);
+	}
+	auto index_of = [&transform_index](Transform const *t) -> uint32_t {
+		if (t == nullptr) return -1U;
+		auto f = transform_index.find(t);
+		assert(f != transform_index.end() && "Scene objects should only refer to that scene's transforms.");
+		return f->second;
+	};
+
+	{ //set parent indices:
+		uint32_t i = 0;
+		for (auto const &t : scene.transforms) {
+			transforms[i].parent = index_of(t.parent);
+			++i;
+		}
+	}
+
+	drawables.reserve(scene.drawables.size());
+	for (auto const &d : scene.drawables) {
+		drawables.emplace_back();
+		drawables.back().transform = index_of(d.transform);
+		drawables.back().pipeline = d.pipeline;
+		drawables.back().min = d.min;
+		drawables.back().max = d.max;
+		drawables.back().sphere_center = d.sphere_center;
+		drawables.back().sphere_radius = d.sphere_radius;
+		std::copy(d.lods, d.lods + Drawable::MaxLods, drawables.back().lods);
+		drawables.back().lod_count = d.lod_count;
+		drawables.back().occluder = d.occluder;
+		drawables.back().palette_begin = uint32_t(palettes.size());
+		for (uint32_t p = d.palette_begin; p < d.palette_begin + d.palette_count; ++p) {
+			PalettePart const &part = scene.palette[p];
+			palettes.emplace_back();
+			palettes.back().transform = index_of(part.transform);
+			palettes.back().min = part.min;
+			palettes.back().max = part.max;
+			palettes.back().sphere_center = part.sphere_center;
+			palettes.back().sphere_radius = part.sphere_radius;
+		}
+		drawables.back().palette_end = uint32_t(palettes.size());
+	}
+
+	cameras.reserve(scene.cameras.size());
+	for (auto const &c : scene.cameras) {
+		cameras.emplace_back();
+		cameras.back().transform = index_of(c.transform);
+		cameras.back().fovy = c.fovy;
+		cameras.back().aspect = c.aspect;
+		cameras.back().near_plane = c.near;
+	}
+
+	lights.reserve(scene.lights.size());
+	for (auto const &l : scene.lights) {
+		lights.emplace_back();
+		lights.back().transform = index_of(l.transform);
+		lights.back().type = l.type;
+		lights.back().energy = l.energy;
+		lights.back().spot_fov = l.spot_fov;
+	}
+}
+
+void Scene::spawn(Prefab const &prefab, Transform *parent, std::vector< Transform * > *spawned_) {
+	assert(prefab.names.size() == prefab.transforms.size());
+
+	std::vector< Transform * > spawned_temp;
+	std::vector< Transform * > &spawned = *(spawned_ ? spawned_ : &spawned_temp);
+	spawned.clear();
+	spawned.reserve(prefab.transforms.size());
+
+	//make transforms, remembering them by index:
+	for (size_t i = 0; i < prefab.transforms.size(); ++i) {
+		Prefab::TransformData const &data = prefab.transforms[i];
+		transforms.emplace_back();
+		Transform &t = transforms.back();
+		t.name_ = prefab.names[i];
+		transform_index.emplace(t.name_, &t);
+		t.position = data.position;
+		t.rotation = data.rotation;
+		t.scale = data.scale;
+		t.is_static = data.is_static;
+		spawned.emplace_back(&t);
+	}
+
+	//hook up parents (parents may come after children in the array, so this is a second pass):
+	for (size_t i = 0; i < prefab.transforms.size(); ++i) {
+		uint32_t p = prefab.transforms[i].parent;
+		assert(p == -1U || p < spawned.size());
+		spawned[i]->parent = (p == -1U ? parent : spawned[p]);
+	}
+
+	for (auto const &data : prefab.drawables) {
+		assert(data.transform < spawned.size());
+		drawables.emplace_back(spawned[data.transform]);
+		Drawable &drawable = drawables.back();
+		drawable.pipeline = data.pipeline;
+		drawable.min = data.min;
+		drawable.max = data.max;
+		drawable.sphere_center = data.sphere_center;
+		drawable.sphere_radius = data.sphere_radius;
+		std::copy(data.lods, data.lods + Drawable::MaxLods, drawable.lods);
+		drawable.lod_count = data.lod_count;
+		drawable.occluder = data.occluder;
+		assert(data.palette_begin <= data.palette_end && data.palette_end <= prefab.palettes.size());
+		drawable.palette_begin = uint32_t(palette.size());
+		drawable.palette_count = data.palette_end - data.palette_begin;
+		for (uint32_t p = data.palette_begin; p < data.palette_end; ++p) {
+			Prefab::PaletteData const &part = prefab.palettes[p];
+			assert(part.transform < spawned.size());
+			palette.emplace_back();
+			palette.back().transform = spawned[part.transform];
+			palette.back().min = part.min;
+			palette.back().max = part.max;
+			palette.back().sphere_center = part.sphere_center;
+			palette.back().sphere_radius = part.sphere_radius;
+		}
+
+		//track in the BVH (as in update_bvh(), but without visiting existing drawables):
+		BVH::AABB bounds(drawable.min, drawable.max);
+		if (!bounds.empty()) {
+			drawable.bvh_leaf = bvh.insert(bounds.transformed(drawable.transform->make_local_to_world()), &drawable);
+		}
+	}
+
+	for (auto const &data : prefab.cameras) {
+		assert(data.transform < spawned.size());
+		cameras.emplace_back(spawned[data.transform]);
+		Camera &camera = cameras.back();
+		camera.fovy = data.fovy;
+		camera.aspect = data.aspect;
+		camera.near = data.near_plane;
+	}
+
+	for (auto const &data : prefab.lights) {
+		assert(data.transform < spawned.size());
+		lights.emplace_back(spawned[data.transform]);
+		Light &light = lights.back();
+		light.type = data.type;
+		light.energy = data.energy;
+		light.spot_fov = data.spot_fov;
+	}
+}
+
+//-------------------------
+
+Scene::Transform *Scene::find_transform(std::string_view name) const {
+	auto f = transform_index.find(name);
+	if (f == transform_index.end()) return nullptr;
+	return f->second;
+}
+
+void Scene::index_transforms() {
+	transform_index.clear();
+	transform_index.reserve(transforms.size());
+	for (auto &t : transforms) {
+		transform_index.emplace(t.name_, &t);
+	}
+}
+
+std::string_view Scene::intern(std::string_view str) {
+	//n.b. unordered_set elements never move, so views of them stay valid:
+	static std::unordered_set< std::string > pool;
+	static std::mutex pool_mutex; //(scenes may be loaded on worker threads)
+	std::lock_guard< std::mutex > lock(pool_mutex);
+	return *pool.emplace(str).first;
+}
+
+//-------------------------
+
+void Scene::erase(std::vector< Transform * > const &to_erase) {
+	std::unordered_set< Transform const * > erasing(to_erase.begin(), to_erase.end());
+
+	auto erasing_palette = [this,&erasing](Drawable const &d) {
+		for (uint32_t p = d.palette_begin; p < d.palette_begin + d.palette_count; ++p) {
+			if (erasing.count(palette[p].transform)) return true;
+		}
+		return false;
+	};
+	bool erased_palette = false;
+	for (auto d = drawables.begin(); d != drawables.end(); /* later */) {
+		if (erasing.count(d->transform) || erasing_palette(*d)) {
+			if (d->palette_count != 0) erased_palette = true;
+			if (d->bvh_leaf != -1U) bvh.remove(d->bvh_leaf);
+			d = drawables.erase(d);
+		} else {
+			++d;
+		}
+	}
+
+	//drop the parts of erased palette drawables:
+	if (erased_palette) {
+		std::vector< PalettePart > remaining;
+		for (auto &d : drawables) {
+			if (d.palette_count == 0) continue;
+			uint32_t begin = uint32_t(remaining.size());
+			remaining.insert(remaining.end(), palette.begin() + d.palette_begin, palette.begin() + d.palette_begin + d.palette_count);
+			d.palette_begin = begin;
+		}
+		palette = std::move(remaining);
+	}
+	cameras.remove_if([&erasing](Camera const &c){ return erasing.count(c.transform) != 0; });
+	lights.remove_if([&erasing](Light const &l){ return erasing.count(l.transform) != 0; });
+
+	bool reindex = false;
+	for (auto t = transforms.begin(); t != transforms.end(); /* later */) {
+		if (erasing.count(&*t)) {
+			auto f = transform_index.find(t->name_);
+			if (f != transform_index.end() && f->second == &*t) {
+				transform_index.erase(f);
+				reindex = true;
+			}
+			t = transforms.erase(t);
+		} else {
+			assert(!erasing.count(t->parent) && "Transforms being erased should not be parents of transforms that remain.");
+			++t;
+		}
+	}
+
+	//if an indexed transform was erased, another transform with the same name may now be first:
+	if (reindex) {
+		for (auto &t : transforms) {
+			transform_index.emplace(t.name_, &t);
+		}
+	}
+}
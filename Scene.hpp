@@ -8,24 +8,37 @@
  *  - Camera information (via "Camera")
  *  - Light information (via "Light")
  *
+ * Drawables with bounds are also tracked in a bounding volume hierarchy
+ *  (via "BVH") that is used to cull drawing and to answer spatial queries.
+ *
  */
 
 #include "GL.hpp"
+#include "BVH.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <list>
+#include <limits>
 #include <memory>
 #include <functional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include <unordered_map>
 
+struct OcclusionBuffer;
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		// (names point into storage that lives as long as the program -- see Scene::intern() -- so copying a transform doesn't copy its name)
+		std::string_view name() const { return name_; }
+		// set_name() interns 'name', so it may be passed a temporary;
+		// n.b. doesn't update the owning scene's name index -- call Scene::index_transforms() after renaming
+		void set_name(std::string_view name);
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -35,6 +48,13 @@ struct Scene {
 		//The transform above may be relative to some parent transform:
 		Transform *parent = nullptr;
 
+		//A promise that this transform won't change after load:
+		// drawables whose transforms (and ancestors) are all static can be baked into merged draws (see StaticBatch.hpp)
+		// and aren't refit by update_bvh()
+		bool is_static = false;
+		//true if this transform and all of its ancestors are static:
+		bool never_moves() const;
+
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_local_to_parent() const;
@@ -47,6 +67,11 @@ struct Scene {
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+
+	private:
+		//always an interned view (Scene's loading functions assign names they have already interned):
+		std::string_view name_;
+		friend struct Scene;
 	};
 
 	struct Drawable {
@@ -56,7 +81,7 @@ struct Scene {
 
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
-			GLuint program = 0; //shader program; passed to glUseProgram
+			uint32_t material = 0; //program, textures, and uniform values; index into the material registry (see Material, below)
 
 			//attributes:
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
@@ -65,20 +90,57 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
-			//uniforms:
-			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
-			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
-			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
+			//indexed drawing: if not GL_NONE, the type of the indices in the element buffer bound in 'vao'
+			// (start and count are then the first index and number of indices; passed to glDrawElements):
+			GLenum index_type = GL_NONE;
 
-			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
-
-			//texture objects to bind for the first TextureCount textures:
-			enum : uint32_t { TextureCount = 4 };
-			struct TextureInfo {
-				GLuint texture = 0;
-				GLenum target = GL_TEXTURE_2D;
-			} textures[TextureCount];
+			//quantized positions: vertex positions are decoded as position_offset + position_scale * Position
+			// (folded into the object matrices; usually copied from Mesh::position_scale/offset):
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
 		} pipeline;
+
+		//(optional) object-space bounding box, usually copied from Mesh::min/max:
+		// drawables with bounds are placed in Scene::bvh by update_bvh() and culled when drawing;
+		// drawables with empty bounds are never culled.
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//(optional) object-space bounding sphere, usually copied from Mesh::sphere_center/radius:
+		// used to pick levels of detail; if the radius is negative, the sphere around min/max is used instead.
+		glm::vec3 sphere_center = glm::vec3(0.0f);
+		float sphere_radius = -1.0f;
+
+		//leaf holding this drawable in Scene::bvh (managed by update_bvh()):
+		uint32_t bvh_leaf = -1U;
+
+		//(optional) levels of detail, most detailed first, which replace pipeline.type/start/count/position_scale/position_offset when drawing:
+		// (levels share pipeline.index_type, so they must come from the same buffer as the pipeline)
+		// level i is used while the drawable's bounding sphere covers at least lods[i].min_size of the screen height;
+		// the last level is used for anything smaller. Requires bounds (min/max, above).
+		enum : uint32_t { MaxLods = 4 };
+		struct Lod {
+			GLenum type = GL_TRIANGLES;
+			GLuint start = 0;
+			GLuint count = 0;
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
+			float min_size = 0.0f;
+		} lods[MaxLods];
+		uint32_t lod_count = 0; //zero means "no levels of detail; just draw pipeline"
+		// (the level each drawable was last drawn at is remembered per view, in DrawList::lod_levels)
+
+		//(optional) occluder: object-space triangle list (three vertices per triangle) drawn into occlusion buffers
+		// by render_occluders(); should be a few large triangles that lie inside the drawn mesh (e.g., MeshBuffer::lookup_occluder()).
+		// (not owned; must outlive the drawable)
+		std::vector< glm::vec3 > const *occluder = nullptr;
+
+		//(optional) matrix palette: if palette_count isn't zero, each vertex picks Scene::palette[palette_begin + PaletteIndex] as its part
+		// (so one drawable can draw all the parts of an articulated model; see PaletteBatch.hpp).
+		// update_bvh() refits the bounds (min/max, in 'transform' space) around the parts in their current poses.
+		// (palette drawables need a material that reads matrices by draw id, and are never instanced)
+		uint32_t palette_begin = 0;
+		uint32_t palette_count = 0;
 	};
 
 	struct Camera {
@@ -116,17 +178,256 @@ struct Scene {
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
 	};
 
+	//A 'Material' is the shared part of drawing state -- program, textures, and constant uniform values:
+	// materials are added to a global registry once (usually in a Load<> function) and never change afterward;
+	// drawables refer to them by index, so drawables are cheap to copy and drawables with the same material batch together.
+	struct Material {
+		GLuint program = 0; //shader program; passed to glUseProgram
+
+		//uniform locations for the matrices Scene computes for every drawable:
+		GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
+		GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
+		GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
+
+		//per-frame object matrices (optional):
+		// if the program reads its matrices from the object matrix buffer (see ObjectMatrices, below)
+		// instead of the uniforms above, drawables sharing all pipeline state are drawn together
+		// with glDrawArraysInstanced, and instance i uses the matrices for draw id DRAW_BASE + i:
+		GLuint DRAW_BASE_int = -1U; //uniform location for first draw id
+
+		//may drawables with this material be drawn in the depth pre-pass (see DrawList::submit)?
+		// requires that the program declares "layout(location = 0) in vec4 Position;" and "invariant gl_Position;",
+		// doesn't put any other attribute at location 1 (DepthProgram reads PaletteIndex there),
+		// computes gl_Position as OBJECT_TO_CLIP * Position, and never discards fragments
+		bool depth_prepass = false;
+
+		//texture objects to bind for the first TextureCount textures:
+		enum : uint32_t { TextureCount = 4 };
+		struct TextureInfo {
+			GLuint texture = 0;
+			GLenum target = GL_TEXTURE_2D;
+		} textures[TextureCount];
+
+		//constant uniform values, set whenever the material is bound:
+		enum : uint32_t { UniformCount = 8 };
+		struct UniformValue {
+			GLuint location = -1U; //-1U marks an unused slot
+			enum Type : uint32_t {
+				Int,
+				Float,
+				Vec2,
+				Vec3,
+				Vec4,
+			} type = Float;
+			union {
+				int32_t i[4] = {0, 0, 0, 0};
+				float f[4];
+			};
+		} uniforms[UniformCount];
+
+		//store a uniform value in the next free slot:
+		// (does nothing if location is -1U, as returned by glGetUniformLocation for unused uniforms; throws if all slots are used)
+		void set_uniform(GLuint location, int32_t value);
+		void set_uniform(GLuint location, float value);
+		void set_uniform(GLuint location, glm::vec2 const &value);
+		void set_uniform(GLuint location, glm::vec3 const &value);
+		void set_uniform(GLuint location, glm::vec4 const &value);
+	};
+	static_assert(std::is_trivially_copyable< Material >::value, "Materials are plain data.");
+
+	//The material registry:
+	// index 0 is an empty material (program 0), which is never drawn.
+	// NOTE: register materials before recording draw lists on other threads; registration is not synchronized.
+	static uint32_t register_material(Material const &material);
+	static Material const &get_material(uint32_t index);
+
+	//Matrices for one draw, as stored in the per-frame object matrix buffer:
+	// Scene::record computes these for every drawable and DrawList::submit uploads them into a single buffer,
+	// which is bound as an RGBA32F samplerBuffer on texture unit ObjectMatricesTextureUnit.
+	// Each draw uses ten texels, starting at texel 10 * draw_id:
+	struct ObjectMatrices {
+		//(positions are decoded with position_scale/offset before object_to_world; normals are not)
+		ObjectMatrices(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, glm::mat4x3 const &object_to_world,
+			glm::vec3 const &position_scale = glm::vec3(1.0f), glm::vec3 const &position_offset = glm::vec3(0.0f));
+		glm::mat4 OBJECT_TO_CLIP; //texels 0-3: columns
+		glm::mat3x4 OBJECT_TO_LIGHT_rows; //texels 4-6: rows of the mat4x3 OBJECT_TO_LIGHT
+		glm::mat3x4 NORMAL_TO_LIGHT; //texels 7-9: columns (w unused)
+	};
+	static_assert(sizeof(ObjectMatrices) == 10 * 4 * 4, "ObjectMatrices is packed.");
+	enum : uint32_t { ObjectMatricesTextureUnit = Material::TextureCount };
+
+	//A DrawList is a recorded sequence of draw commands, built by Scene::record() and replayed by submit():
+	// recording only reads the scene and makes no OpenGL calls, so it may run on a worker thread
+	// (as long as nothing modifies the scene meanwhile); submit() must run on the thread that owns the GL context.
+	struct DrawList {
+		struct Command {
+			uint32_t material = 0; //index into the material registry
+			GLuint vao = 0;
+			GLenum type = GL_TRIANGLES;
+			GLuint start = 0;
+			GLuint count = 0;
+			GLenum index_type = GL_NONE; //GL_NONE for glDrawArrays, otherwise glDrawElements
+			uint32_t instances = 1; //more than one only for materials using DRAW_BASE
+			uint32_t draw_id = 0; //index of (first instance's) matrices in 'matrices'
+		};
+		static_assert(std::is_trivially_copyable< Command >::value, "Commands are plain data.");
+
+		std::vector< Command > commands;
+		std::vector< ObjectMatrices > matrices;
+
+		//level of detail each drawable with levels was recorded at, so the next record() into this list can lag changes a bit (avoiding popping):
+		// (kept by clear(); reuse one DrawList per view to get this hysteresis -- drawables without an entry just get the level their size calls for)
+		std::unordered_map< Drawable const *, uint32_t > lod_levels;
+
+		//culling results from record(), added to render_stats by submit():
+		uint32_t objects_drawn = 0;
+		uint32_t objects_culled = 0;
+
+		void clear();
+		//send all commands to OpenGL:
+		// if 'depth_prepass' is set, drawables whose material allows it first have their depth drawn with DepthProgram,
+		// then are shaded with a GL_EQUAL depth test (and depth writes off), so each pixel is shaded at most once.
+		// n.b. the caller's depth function and write mask are restored afterward
+		void submit(bool depth_prepass = false) const;
+	};
+
 	//Scenes, of course, may have many of the above objects:
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//Parts of all palette drawables (see Drawable::palette_begin), in one array so drawables don't each allocate their own:
+	struct PalettePart {
+		Transform *transform = nullptr;
+		//bounds of the part's vertices, in 'transform' space (as Drawable::min/max and sphere_center/radius):
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 sphere_center = glm::vec3(0.0f);
+		float sphere_radius = -1.0f;
+	};
+	std::vector< PalettePart > palette;
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
-	void draw(Camera const &camera) const;
+	// (if 'depth_prepass' is set, draws with a depth pre-pass; see DrawList::submit)
+	void draw(Camera const &camera, bool depth_prepass = false) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
-	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f), bool depth_prepass = false) const;
+
+	//..or to split drawing into recording (culling, sorting, computing matrices) and submission:
+	// (draw() is just record() followed by submit(); 'list' is cleared first)
+	// if 'occlusion' is given, drawables it hides are skipped (see render_occluders(), below)
+	void record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, DrawList *list, OcclusionBuffer const *occlusion = nullptr) const;
+
+	//levels of detail only change once the screen size is this fraction past a level's threshold:
+	float lod_hysteresis = 0.1f;
+
+	//Bounding volume hierarchy over the world-space bounds of drawables:
+	// (leaf data is a Drawable *)
+	BVH bvh;
+
+	//insert drawables into the BVH and refit it to current transforms:
+	// call after moving transforms (cheap if little moved; static drawables are skipped); called automatically by load() and set()
+	// NOTE: if you erase a drawable, remove it first with 'bvh.remove(drawable.bvh_leaf)'
+	void update_bvh();
+
+	//drawables that should be sent to OpenGL for a given view:
+	// (those whose bounds touch the view frustum and aren't hidden in 'occlusion' + those without bounds)
+	void gather_visible(glm::mat4 const &world_to_clip, std::vector< Drawable const * > *visible, OcclusionBuffer const *occlusion = nullptr) const;
+
+	//fill an occlusion buffer with the occluders of all drawables in view:
+	// (call once per frame, before record() or gather_visible() with the same buffer)
+	void render_occluders(glm::mat4 const &world_to_clip, OcclusionBuffer *occlusion) const;
+
+	//closest drawable whose bounds are hit by a ray (e.g., for mouse picking); nullptr if none:
+	// (if 'distance' is given, it is set to the ray parameter of the hit)
+	Drawable *pick(glm::vec3 const &origin, glm::vec3 const &direction, float *distance = nullptr) const;
+
+	//drawables whose bounds overlap a world-space box:
+	void overlapping(BVH::AABB const &box, std::vector< Drawable * > *found) const;
+
+	//Name -> transform index, for fast lookup of named transforms:
+	// (if several transforms share a name, the first one added is found)
+	std::unordered_map< std::string_view, Transform * > transform_index;
+
+	//look up a transform by name; returns nullptr if there is no such transform:
+	Transform *find_transform(std::string_view name) const;
+
+	//rebuild transform_index from scratch:
+	// load(), spawn(), and set() maintain the index; call this if you add, remove, or rename transforms yourself
+	void index_transforms();
+
+	//get a copy of a string that stays valid (and at the same address) for the life of the program:
+	// (equal strings are only stored once; safe to call from any thread)
+	static std::string_view intern(std::string_view str);
+
+	//A 'Prefab' is a flattened, pointer-free copy of a scene that is fast to spawn (possibly many times):
+	// hierarchy is stored as indices into 'transforms', so spawning needs no pointer remapping table
+	// (building a Prefab from a Scene does the pointer-to-index mapping once, up front).
+	struct Prefab {
+		struct TransformData {
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			uint32_t parent = -1U; //index into 'transforms', or -1U for no parent
+			bool is_static = false;
+		};
+		struct DrawableData {
+			uint32_t transform = -1U; //index into 'transforms'
+			Drawable::Pipeline pipeline;
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+			glm::vec3 sphere_center = glm::vec3(0.0f);
+			float sphere_radius = -1.0f;
+			Drawable::Lod lods[Drawable::MaxLods];
+			uint32_t lod_count = 0;
+			std::vector< glm::vec3 > const *occluder = nullptr;
+			uint32_t palette_begin = 0, palette_end = 0; //range in 'palettes'
+		};
+		struct PaletteData {
+			uint32_t transform = -1U; //index into 'transforms'
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+			glm::vec3 sphere_center = glm::vec3(0.0f);
+			float sphere_radius = -1.0f;
+		};
+		struct CameraData {
+			uint32_t transform = -1U; //index into 'transforms'
+			float fovy = glm::radians(60.0f);
+			float aspect = 1.0f;
+			float near_plane = 0.01f;
+		};
+		struct LightData {
+			uint32_t transform = -1U; //index into 'transforms'
+			Light::Type type = Light::Point;
+			glm::vec3 energy = glm::vec3(1.0f);
+			float spot_fov = glm::radians(45.0f);
+		};
+		static_assert(std::is_trivially_copyable< TransformData >::value, "Prefab arrays are plain data.");
+		static_assert(std::is_trivially_copyable< DrawableData >::value, "Prefab arrays are plain data.");
+		static_assert(std::is_trivially_copyable< PaletteData >::value, "Prefab arrays are plain data.");
+
+		std::vector< TransformData > transforms;
+		std::vector< std::string_view > names; //name of each transform (interned)
+		std::vector< DrawableData > drawables;
+		std::vector< PaletteData > palettes; //drawable palettes (parts refer to 'transforms' by index)
+		std::vector< CameraData > cameras;
+		std::vector< LightData > lights;
+
+		Prefab() = default;
+		Prefab(Scene const &scene); //flatten a scene
+	};
+
+	//add a copy of a prefab's contents to this scene:
+	// prefab transforms without a parent are parented to 'parent'
+	// if 'spawned' is given, it is set to the new transforms, in the same order as prefab.transforms
+	void spawn(Prefab const &prefab, Transform *parent = nullptr, std::vector< Transform * > *spawned = nullptr);
+
+	//remove transforms along with any drawables, cameras, and lights attached to them:
+	// (drawables with erased transforms in their palette are removed too)
+	// (transforms that remain must not have erased transforms as parents)
+	void erase(std::vector< Transform * > const &transforms);
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
@@ -135,17 +436,30 @@ struct Scene {
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
 
+	//as above, but with the file's mesh table resolved all at once (e.g., by MeshBuffer::resolve), so making drawables needs no name lookups:
+	// 'resolve_meshes' is called once with each distinct mesh name in the file, and returns an id (e.g., a MeshBuffer::Handle) for each;
+	// 'on_drawable' is then passed the id of each drawable's mesh
+	void load(std::string const &filename,
+		std::function< std::vector< uint32_t >(std::vector< std::string_view > const &) > const &resolve_meshes,
+		std::function< void(Scene &, Transform *, uint32_t) > const &on_drawable
+	);
+
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// ('str0' is the file's string table, which stays valid for the life of the program)
+	virtual void load_extra(std::istream &from, std::string_view str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
 
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
+	Scene(std::string const &filename,
+		std::function< std::vector< uint32_t >(std::vector< std::string_view > const &) > const &resolve_meshes,
+		std::function< void(Scene &, Transform *, uint32_t) > const &on_drawable);
 
 	//copy a scene (with proper pointer fixup):
+	// (if you are making many copies of the same scene, spawning a Prefab is faster)
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
@@ -0,0 +1,192 @@
+#include "SceneStreamer.hpp"
+
+#include "gl_errors.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+SceneStreamer::SceneStreamer(Scene &scene_) : scene(scene_) {
+	worker = std::thread(&SceneStreamer::worker_main, this);
+}
+
+SceneStreamer::~SceneStreamer() {
+	{ //stop the worker:
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+		jobs.clear();
+	}
+	wake_worker.notify_all();
+	worker.join();
+
+	for (auto &state : regions) {
+		if (state.state == Loaded) unload(state);
+	}
+	//(anything not spawned is freed along with 'regions' and 'finished')
+}
+
+uint32_t SceneStreamer::add_region(Region const &region) {
+	regions.emplace_back();
+	regions.back().region = region;
+	return uint32_t(regions.size() - 1);
+}
+
+SceneStreamer::State SceneStreamer::get_state(uint32_t region) const {
+	assert(region < regions.size());
+	return regions[region].state;
+}
+
+void SceneStreamer::update(glm::vec3 const &viewer, float budget) {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto elapsed = [&start]() -> float {
+		return std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - start).count();
+	};
+
+	//(1) decide which regions should be loaded:
+	bool queued = false;
+	for (uint32_t i = 0; i < regions.size(); ++i) {
+		RegionState &state = regions[i];
+		float distance = glm::length(viewer - state.region.center);
+		//n.b. between the radii, regions stay as they are:
+		if (distance < state.region.load_radius) state.wanted = true;
+		else if (distance > state.region.unload_radius) state.wanted = false;
+
+		if (state.wanted && state.state == Unloaded) {
+			std::unique_lock< std::mutex > lock(mutex);
+			jobs.emplace_back(Job{i, state.region});
+			state.state = Loading;
+			queued = true;
+		} else if (!state.wanted && state.state == Uploading) {
+			state.contents.reset();
+			state.state = Unloaded;
+		} else if (!state.wanted && state.state == Loaded) {
+			unload(state);
+		}
+		//(regions that are Loading are dealt with once the worker is done with them)
+	}
+	if (queued) wake_worker.notify_one();
+
+	//(2) collect regions the worker has finished reading:
+	std::vector< std::pair< uint32_t, std::unique_ptr< Contents > > > done;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		done.swap(finished);
+	}
+	for (auto &[index, contents] : done) {
+		RegionState &state = regions[index];
+		assert(state.state == Loading);
+		if (!contents->error.empty()) {
+			std::cerr << "WARNING: failed to load region from '" << state.region.scene_filename << "': " << contents->error << std::endl;
+			state.state = Failed;
+		} else if (!state.wanted) {
+			state.state = Unloaded; //viewer left while the region was being read
+		} else {
+			state.contents = std::move(contents);
+			state.state = Uploading;
+		}
+	}
+
+	//(3) upload, a slice at a time, until the budget runs out:
+	// (at least one slice is uploaded per frame, so progress is always made)
+	bool first = true;
+	for (auto &state : regions) {
+		if (state.state != Uploading) continue;
+		while (first || elapsed() < budget) {
+			first = false;
+			if (state.contents->meshes->upload(upload_slice)) {
+				finish_upload(state);
+				break;
+			}
+		}
+		if (elapsed() >= budget) break;
+	}
+}
+
+void SceneStreamer::finish_upload(RegionState &state) {
+	assert(state.state == Uploading);
+	assert(state.contents);
+
+	state.vao = state.contents->meshes->make_vao_for_program(state.region.program);
+	for (auto &drawable : state.contents->prefab.drawables) {
+		drawable.pipeline.vao = state.vao;
+	}
+
+	//place the region:
+	scene.transforms.emplace_back();
+	Scene::Transform *placement = &scene.transforms.back();
+	placement->position = state.region.position;
+	scene.spawn(state.contents->prefab, placement, &state.spawned);
+	state.spawned.emplace_back(placement);
+
+	//the prefab isn't needed anymore, but the mesh buffer is:
+	state.contents->prefab = Scene::Prefab();
+	state.state = Loaded;
+
+	GL_ERRORS();
+}
+
+void SceneStreamer::unload(RegionState &state) {
+	assert(state.state == Loaded);
+
+	scene.erase(state.spawned);
+	state.spawned.clear();
+
+	state.vao = 0; //(owned by MeshBuffer's vertex array cache, and shared by every buffer in the same vertex arena block)
+	state.contents.reset(); //(deletes mesh buffer)
+
+	state.state = Unloaded;
+}
+
+void SceneStreamer::worker_main() {
+	while (true) {
+		Job job;
+		{ //wait for a job:
+			std::unique_lock< std::mutex > lock(mutex);
+			wake_worker.wait(lock, [this](){ return quit || !jobs.empty(); });
+			if (quit) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		//read the region (no OpenGL calls allowed here):
+		auto contents = std::make_unique< Contents >();
+		try {
+			contents->meshes = std::make_unique< MeshBuffer >(job.desc.meshes_filename, MeshBuffer::Deferred);
+			MeshBuffer const &meshes = *contents->meshes;
+			Scene::Drawable::Pipeline const &pipeline = job.desc.pipeline;
+
+			Scene temp;
+			auto resolve = [&meshes](std::vector< std::string_view > const &mesh_names) {
+				return meshes.resolve(mesh_names);
+			};
+			temp.load(job.desc.scene_filename, resolve, [&meshes, &pipeline](Scene &region_scene, Scene::Transform *transform, MeshBuffer::Handle handle){
+				Mesh const &mesh = meshes.get(handle);
+
+				region_scene.drawables.emplace_back(transform);
+				Scene::Drawable &drawable = region_scene.drawables.back();
+
+				drawable.pipeline = pipeline;
+				drawable.pipeline.type = mesh.type;
+				drawable.pipeline.start = mesh.start;
+				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.position_scale = mesh.position_scale;
+				drawable.pipeline.position_offset = mesh.position_offset;
+
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
+				drawable.sphere_center = mesh.sphere_center;
+				drawable.sphere_radius = mesh.sphere_radius;
+			});
+			contents->prefab = Scene::Prefab(temp);
+		} catch (std::exception &e) {
+			contents->error = e.what();
+			contents->meshes.reset();
+		}
+
+		{ //hand the result to the main thread:
+			std::unique_lock< std::mutex > lock(mutex);
+			finished.emplace_back(job.region, std::move(contents));
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+/*
+ * A SceneStreamer loads and unloads regions of a world in the background.
+ *
+ * Each region is a scene file plus the mesh buffer its drawables use.
+ * Regions are loaded when the viewer comes within 'load_radius' of their
+ *  center and unloaded when it moves beyond 'unload_radius'.
+ *
+ * Files are read and parsed on a worker thread (into a MeshBuffer with
+ *  deferred upload and a Scene::Prefab); the main thread only uploads vertex
+ *  data -- in slices, under a per-frame time budget -- and spawns the prefab
+ *  into the target scene.
+ *
+ */
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SceneStreamer {
+	//regions are spawned into 'scene', which must outlive the streamer:
+	SceneStreamer(Scene &scene);
+	//stops the worker thread and unloads all regions:
+	// (call from the thread that owns the GL context)
+	~SceneStreamer();
+
+	SceneStreamer(SceneStreamer const &) = delete;
+	SceneStreamer &operator=(SceneStreamer const &) = delete;
+
+	struct Region {
+		std::string scene_filename; //scene to spawn
+		std::string meshes_filename; //meshes referenced by the scene
+		GLuint program = 0; //program to make the mesh buffer's vao for
+		Scene::Drawable::Pipeline pipeline; //template for the region's drawables (vao, type, start, and count are filled in)
+
+		glm::vec3 position = glm::vec3(0.0f); //offset of the region's scene (its top-level transforms are spawned under a transform here)
+
+		glm::vec3 center = glm::vec3(0.0f);
+		float load_radius = 100.0f; //load when the viewer is closer than this
+		float unload_radius = 120.0f; //unload when the viewer is farther than this (should be larger than load_radius)
+	};
+
+	//add a region (initially unloaded); returns its index:
+	uint32_t add_region(Region const &region);
+
+	//call once per frame from the thread that owns the GL context:
+	// starts loads and unloads based on the viewer's position,
+	// then uploads finished loads for (roughly) at most 'budget' seconds
+	void update(glm::vec3 const &viewer, float budget = 0.002f);
+
+	//bytes of vertex data uploaded at a time (the budget is checked between slices):
+	size_t upload_slice = 256 * 1024;
+
+	enum State {
+		Unloaded,
+		Loading, //waiting for (or being read by) the worker thread
+		Uploading, //read; waiting for (or being) uploaded by update()
+		Loaded, //spawned into the scene
+		Failed, //loading threw an exception (which was reported); won't be retried
+	};
+	State get_state(uint32_t region) const;
+
+	//-- internals ---
+
+	Scene &scene;
+
+	//result of reading a region on the worker thread:
+	struct Contents {
+		std::unique_ptr< MeshBuffer > meshes;
+		Scene::Prefab prefab;
+		std::string error; //non-empty if loading failed
+	};
+
+	struct RegionState {
+		Region region;
+		State state = Unloaded;
+		bool wanted = false; //should the region be loaded? (may change while the worker is reading it)
+		std::unique_ptr< Contents > contents; //(while Uploading or Loaded)
+		GLuint vao = 0; //(while Loaded)
+		std::vector< Scene::Transform * > spawned; //(while Loaded; the last one is the transform placing the region)
+	};
+	std::vector< RegionState > regions;
+
+	void finish_upload(RegionState &state);
+	void unload(RegionState &state);
+
+	//worker thread and its queues (guarded by 'mutex'):
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake_worker;
+	bool quit = false;
+	struct Job {
+		uint32_t region;
+		Region desc; //copy, so the worker never reads 'regions'
+	};
+	std::deque< Job > jobs;
+	std::vector< std::pair< uint32_t, std::unique_ptr< Contents > > > finished;
+
+	void worker_main();
+};
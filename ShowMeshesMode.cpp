@@ -3,6 +3,7 @@
 #include "ShowMeshesProgram.hpp"
 #include "DrawLines.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
@@ -152,46 +153,30 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) --f;
-	if (f == buffer.meshes.end()) f = buffer.meshes.begin();
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
-	} else {
-		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
-		current_mesh_min = glm::vec3(0.0f);
-		current_mesh_max = glm::vec3(0.0f);
-	}
+	if (buffer.mesh_count() == 0) select_mesh(MeshBuffer::InvalidHandle);
+	else if (current_mesh == MeshBuffer::InvalidHandle || current_mesh == 0) select_mesh(0);
+	else select_mesh(current_mesh - 1);
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) ++f;
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
-			++temp;
-			f = temp.base();
-			assert(f != buffer.meshes.end());
-		}
-	}
+	if (buffer.mesh_count() == 0) select_mesh(MeshBuffer::InvalidHandle);
+	else if (current_mesh == MeshBuffer::InvalidHandle) select_mesh(0);
+	else select_mesh(std::min(current_mesh + 1, buffer.mesh_count() - 1));
+}
 
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+void ShowMeshesMode::select_mesh(MeshBuffer::Handle handle) {
+	current_mesh = handle;
+	if (handle != MeshBuffer::InvalidHandle) {
+		Mesh const &mesh = buffer.get(handle);
+		current_mesh_name = std::string(buffer.name(handle));
+		scene_drawable->pipeline.type = mesh.type;
+		scene_drawable->pipeline.start = mesh.start;
+		scene_drawable->pipeline.count = mesh.count;
+		scene_drawable->pipeline.index_type = mesh.index_type;
+		scene_drawable->pipeline.position_scale = mesh.position_scale;
+		scene_drawable->pipeline.position_offset = mesh.position_offset;
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
@@ -1,5 +1,6 @@
 #include "ShowSceneMode.hpp"
 #include "DrawLines.hpp"
+#include "RenderStats.hpp"
 
 #include <iostream>
 
@@ -61,6 +62,14 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 			return true;
 		}
 	}
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_p) {
+		depth_prepass = !depth_prepass;
+		return true;
+	}
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_o) {
+		occlusion_culling = !occlusion_culling;
+		return true;
+	}
 	//mouse wheel: dolly
 	if (evt.type == SDL_MOUSEWHEEL) {
 		camera.radius *= std::pow(0.5f, 0.1f * evt.wheel.y);
@@ -91,7 +100,12 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 
-	scene.draw(*scene_camera);
+	scene_timer.begin();
+	glm::mat4 world_to_clip = scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local());
+	if (occlusion_culling) scene.render_occluders(world_to_clip, &occlusion);
+	scene.record(world_to_clip, glm::mat4x3(1.0f), &draw_list, occlusion_culling ? &occlusion : nullptr);
+	draw_list.submit(depth_prepass);
+	scene_timer.end();
 
 	{ //decorate with some lines:
 		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
@@ -121,7 +135,7 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, 0.0f, -len)), glm::u8vec4(0x00, 0x00, 0x88, 0xff));
 
 			//transform name:
-			draw_lines.draw_text("'" + transform.name + "'",
+			draw_lines.draw_text("'" + std::string(transform.name()) + "'",
 				xf(glm::vec3(0.05f, 0.0f, 0.05f)),
 				0.15f * xfd(glm::vec3(1.0f, 0.0f, 0.0f)),
 				0.15f * xfd(glm::vec3(0.0f, 0.0f, 1.0f)),
@@ -136,4 +150,28 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		*/
 	}
 
+	{ //show scene drawing time:
+		glDisable(GL_DEPTH_TEST);
+		float aspect = float(drawable_size.x) / float(drawable_size.y);
+		DrawLines lines(glm::mat4(
+			1.0f / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		));
+		//(the effect of occlusion culling shows up in the overlay's culled object count)
+		std::string text = std::string(occlusion_culling ? "occlusion culling" : "no occlusion culling") + " (O to toggle), ";
+		text += std::string(depth_prepass ? "depth pre-pass" : "no pre-pass") + " (P to toggle): ";
+		if (scene_timer.milliseconds < 0.0f) text += "-";
+		else text += std::to_string(scene_timer.milliseconds) + " ms";
+		constexpr float H = 0.06f;
+		lines.draw_text(text,
+			glm::vec3(-aspect + 0.1f * H, -1.0f + 0.1f * H, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+	}
+
+	//show what the previous frame submitted:
+	render_stats.draw_overlay(drawable_size);
+
 }
@@ -10,6 +10,8 @@
 #include "Mode.hpp"
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "GPUTimer.hpp"
+#include "OcclusionBuffer.hpp"
 
 struct ShowSceneMode : Mode {
 	ShowSceneMode(Scene const &scene);
@@ -30,6 +32,17 @@ struct ShowSceneMode : Mode {
 	//Scene being viewed:
 	Scene const &scene;
 
+	//draw with a depth pre-pass? (toggle with 'P'):
+	bool depth_prepass = false;
+	//skip drawables hidden behind the scene's occluders? (toggle with 'O'):
+	bool occlusion_culling = false;
+	OcclusionBuffer occlusion;
+
+	//reused every frame, so levels of detail change with hysteresis (see Scene::DrawList::lod_levels):
+	Scene::DrawList draw_list;
+	//GPU time spent drawing the scene:
+	GPUTimer scene_timer;
+
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
@@ -8,11 +8,16 @@ Scene::Drawable::Pipeline show_scene_program_pipeline;
 Load< ShowSceneProgram > show_scene_program(LoadTagEarly, []() -> ShowSceneProgram * {
 	auto *ret = new ShowSceneProgram();
 
-	show_scene_program_pipeline.program = ret->program;
+	Scene::Material material;
+	material.program = ret->program;
 
-	show_scene_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	show_scene_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	show_scene_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	material.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
+	material.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
+	material.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+
+	material.depth_prepass = true;
+
+	show_scene_program_pipeline.material = Scene::register_material(material);
 
 	return ret;
 });
@@ -25,14 +30,15 @@ ShowSceneProgram::ShowSceneProgram() {
 		"uniform mat4 OBJECT_TO_CLIP;\n"
 		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
 		"uniform mat3 NORMAL_TO_LIGHT;\n"
-		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
-		"in vec4 Color;\n"
-		"in vec2 TexCoord;\n"
+		"layout(location = 0) in vec4 Position;\n" //(fixed location, so vertex arrays also work with DepthProgram)
+		"layout(location = 2) in vec3 Normal;\n" //(location 1 is left for PaletteIndex, which DepthProgram reads)
+		"layout(location = 3) in vec4 Color;\n"
+		"layout(location = 4) in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"invariant gl_Position;\n" //(must match DepthProgram exactly)
 		"void main() {\n"
 		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
 		"	position = OBJECT_TO_LIGHT * Position;\n"
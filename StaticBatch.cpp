@@ -0,0 +1,149 @@
+#include "StaticBatch.hpp"
+
+#include "gl_errors.hpp"
+#include "RenderStats.hpp"
+
+#include <map>
+#include <tuple>
+#include <unordered_set>
+#include <algorithm>
+#include <cstddef>
+
+StaticBatch::StaticBatch(Scene &scene, MeshBuffer const &source, GLuint source_vao, float cell_size) {
+	assert(cell_size > 0.0f);
+
+	//group static drawables by material and cell:
+	std::map< std::tuple< uint32_t, int32_t, int32_t, int32_t >, std::vector< Scene::Drawable * > > groups;
+	for (auto &d : scene.drawables) {
+		if (d.pipeline.vao != source_vao || d.pipeline.type != GL_TRIANGLES) continue;
+		if (d.lod_count != 0 || d.palette_count != 0 || d.occluder != nullptr) continue;
+		if (!d.transform->never_moves()) continue;
+
+		glm::vec3 center = d.transform->make_local_to_world() * glm::vec4(0.5f * (d.min + d.max), 1.0f);
+		if (BVH::AABB(d.min, d.max).empty()) center = d.transform->make_local_to_world()[3];
+		glm::ivec3 cell = glm::ivec3(glm::floor(center / cell_size));
+		groups[std::make_tuple(d.pipeline.material, cell.x, cell.y, cell.z)].emplace_back(&d);
+	}
+	for (auto g = groups.begin(); g != groups.end(); /* later */) {
+		if (g->second.size() < 2) g = groups.erase(g);
+		else ++g;
+	}
+	if (groups.empty()) return;
+
+	//copy each group's vertices (read back from the source buffer, expanded if indexed, and decoded if quantized), transformed to world space:
+	// n.b. the merged buffer always uses the unquantized layout, since world-space positions don't fit any one mesh's bounds
+	bool has_normals = (source.Normal.size != 0);
+	GLuint total = 0;
+	for (auto const &group : groups) {
+		for (auto const *d : group.second) total += d->pipeline.count;
+	}
+
+	std::vector< MeshBuffer::Vertex > data(total);
+	GLuint at = 0;
+	struct Baked {
+		Scene::Drawable::Pipeline pipeline;
+		BVH::AABB bounds;
+	};
+	std::vector< Baked > baked;
+	for (auto const &group : groups) {
+		baked.emplace_back();
+		baked.back().pipeline = group.second[0]->pipeline;
+		baked.back().pipeline.start = at;
+		baked.back().pipeline.index_type = GL_NONE;
+		baked.back().pipeline.position_scale = glm::vec3(1.0f);
+		baked.back().pipeline.position_offset = glm::vec3(0.0f);
+		for (auto const *d : group.second) {
+			std::vector< MeshBuffer::Vertex > part_data = source.read_vertices(d->pipeline.index_type, d->pipeline.start, d->pipeline.count, d->pipeline.position_scale, d->pipeline.position_offset);
+			std::copy(part_data.begin(), part_data.end(), data.begin() + at);
+
+			glm::mat4x3 to_world = d->transform->make_local_to_world();
+			glm::mat3 normal_to_world = glm::inverse(glm::transpose(glm::mat3(to_world)));
+			for (GLuint v = 0; v < d->pipeline.count; ++v) {
+				MeshBuffer::Vertex &vertex = data[at + v];
+				vertex.Position = to_world * glm::vec4(vertex.Position, 1.0f);
+				baked.back().bounds.min = glm::min(baked.back().bounds.min, vertex.Position);
+				baked.back().bounds.max = glm::max(baked.back().bounds.max, vertex.Position);
+				if (has_normals) {
+					glm::vec3 normal = normal_to_world * vertex.Normal;
+					float length = glm::length(normal);
+					if (length > 0.0f) normal /= length;
+					vertex.Normal = normal;
+				}
+			}
+			//mirroring transforms flip the winding of triangles, so swap two corners of each to keep them front-facing:
+			if (glm::determinant(glm::mat3(to_world)) < 0.0f) {
+				for (GLuint v = 0; v + 2 < d->pipeline.count; v += 3) {
+					std::swap(data[at + v + 1], data[at + v + 2]);
+				}
+			}
+			at += d->pipeline.count;
+		}
+		baked.back().pipeline.count = at - baked.back().pipeline.start;
+	}
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(data[0]), data.data(), GL_STATIC_DRAW);
+	render_stats.current.bytes_uploaded += data.size() * sizeof(data[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//one vertex array per program (same attributes as 'source', but unquantized):
+	for (auto const &b : baked) {
+		GLuint program = Scene::get_material(b.pipeline.material).program;
+		if (vaos.count(program)) continue;
+		auto unquantized = [&](MeshBuffer::Attrib const &attrib, GLint size, GLenum type, GLboolean normalized, GLuint offset) {
+			if (attrib.size == 0) return MeshBuffer::Attrib(); //(don't bind attribs 'source' didn't have)
+			return MeshBuffer::Attrib(size, type, normalized, sizeof(MeshBuffer::Vertex), offset);
+		};
+		//n.b. programs with the same attribute locations get the same (cached) vertex array:
+		vaos.emplace(program, MeshBuffer::make_vao(program, buffer, 0, {
+			{"Position", unquantized(source.Position, 3, GL_FLOAT, GL_FALSE, offsetof(MeshBuffer::Vertex, Position))},
+			{"Normal", unquantized(source.Normal, 3, GL_FLOAT, GL_FALSE, offsetof(MeshBuffer::Vertex, Normal))},
+			{"Color", unquantized(source.Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(MeshBuffer::Vertex, Color))},
+			{"TexCoord", unquantized(source.TexCoord, 2, GL_FLOAT, GL_FALSE, offsetof(MeshBuffer::Vertex, TexCoord))},
+		}));
+	}
+
+	GL_ERRORS();
+
+	//remove the baked drawables:
+	std::unordered_set< Scene::Drawable const * > baking;
+	for (auto const &group : groups) {
+		baking.insert(group.second.begin(), group.second.end());
+	}
+	for (auto d = scene.drawables.begin(); d != scene.drawables.end(); /* later */) {
+		if (baking.count(&*d)) {
+			if (d->bvh_leaf != -1U) scene.bvh.remove(d->bvh_leaf);
+			d = scene.drawables.erase(d);
+		} else {
+			++d;
+		}
+	}
+
+	//...and add the merged ones:
+	scene.transforms.emplace_back();
+	transform = &scene.transforms.back();
+	transform->set_name("StaticBatch");
+	transform->is_static = true;
+	scene.transform_index.emplace(transform->name(), transform);
+
+	for (auto const &b : baked) {
+		scene.drawables.emplace_back(transform);
+		Scene::Drawable &drawable = scene.drawables.back();
+		drawable.pipeline = b.pipeline;
+		drawable.pipeline.vao = vaos.at(Scene::get_material(b.pipeline.material).program);
+		drawable.min = b.bounds.min;
+		drawable.max = b.bounds.max;
+		drawables.emplace_back(&drawable);
+	}
+	scene.update_bvh();
+}
+
+StaticBatch::~StaticBatch() {
+	vaos.clear(); //(vertex arrays are owned by MeshBuffer's cache)
+	MeshBuffer::forget_buffer(buffer);
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
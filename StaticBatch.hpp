@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * A StaticBatch bakes drawables that never move into a few merged draws.
+ *
+ * Drawables whose transform (and every ancestor) is marked static are
+ *  grouped by material and by the grid cell their bounds' center falls in.
+ *  Each group's vertices are transformed to world space and copied into one
+ *  shared buffer, and the group is replaced with a single drawable, so a
+ *  mostly-static level (e.g., city.blend) costs one draw per material per
+ *  cell instead of one per object. Cells keep merged drawables small enough
+ *  for frustum culling to remain useful.
+ *
+ */
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+
+#include <unordered_map>
+
+struct StaticBatch {
+	//bake the static drawables in 'scene' which use 'source_vao' (a vertex array for 'source'):
+	// only triangle drawables without levels of detail, palettes, or occluders are baked;
+	// groups with a single drawable are left alone. Baked drawables are attached to a new
+	// (static, identity) transform, 'transform'.
+	StaticBatch(Scene &scene, MeshBuffer const &source, GLuint source_vao, float cell_size = 32.0f);
+	//frees the buffer (and, through MeshBuffer::forget_buffer, the vertex arrays):
+	~StaticBatch();
+
+	StaticBatch(StaticBatch const &) = delete;
+	StaticBatch &operator=(StaticBatch const &) = delete;
+
+	GLuint buffer = 0; //world-space vertex data for all groups
+	std::unordered_map< GLuint, GLuint > vaos; //program -> 'buffer' bound for that program (programs with the same attribute locations share one)
+	Scene::Transform *transform = nullptr; //transform baked drawables are attached to (nullptr if nothing was baked)
+	std::vector< Scene::Drawable * > drawables; //baked drawables, one per group
+};
@@ -0,0 +1,116 @@
+#include "VertexArena.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <cassert>
+
+VertexArena::VertexArena(size_t unit_size_) : unit_size(unit_size_) {
+	assert(unit_size > 0);
+}
+
+VertexArena::Allocation VertexArena::allocate(uint32_t count) {
+	if (uint64_t(count) * unit_size > uint64_t(0xffffffff)) {
+		throw std::runtime_error("Can't allocate " + std::to_string(uint64_t(count) * unit_size) + " bytes in a vertex arena block.");
+	}
+
+	std::lock_guard< std::mutex > lock(mutex);
+
+	Allocation allocation;
+	allocation.count = count;
+
+	//first fit, over blocks in order:
+	for (uint32_t b = 0; b < blocks.size(); ++b) {
+		if (count == 0) {
+			allocation.block = b;
+			return allocation;
+		}
+		auto &free_ranges = blocks[b].free_ranges;
+		for (auto f = free_ranges.begin(); f != free_ranges.end(); ++f) {
+			if (f->second < count) continue;
+			allocation.block = b;
+			allocation.first = f->first;
+			//take the front of the free range:
+			uint32_t rest_first = f->first + count;
+			uint32_t rest_count = f->second - count;
+			free_ranges.erase(f);
+			if (rest_count > 0) free_ranges.emplace(rest_first, rest_count);
+			return allocation;
+		}
+	}
+
+	//nothing fit; start a new block:
+	Block block;
+	block.units = uint32_t(std::max< size_t >(BlockBytes / unit_size, count));
+	if (block.units > count) block.free_ranges.emplace(count, block.units - count);
+	blocks.emplace_back(std::move(block));
+
+	allocation.block = uint32_t(blocks.size() - 1);
+	allocation.first = 0;
+	return allocation;
+}
+
+void VertexArena::free(Allocation const &allocation) {
+	if (allocation.block == -1U || allocation.count == 0) return;
+
+	std::lock_guard< std::mutex > lock(mutex);
+
+	assert(allocation.block < blocks.size());
+	auto &free_ranges = blocks[allocation.block].free_ranges;
+	assert(allocation.first + allocation.count <= blocks[allocation.block].units);
+
+	uint32_t first = allocation.first;
+	uint32_t count = allocation.count;
+
+	//merge with the following free range, if adjacent:
+	auto next = free_ranges.lower_bound(first);
+	assert((next == free_ranges.end() || first + count <= next->first) && "freed range overlaps a free range");
+	if (next != free_ranges.end() && next->first == first + count) {
+		count += next->second;
+		next = free_ranges.erase(next);
+	}
+
+	//...and with the preceding one:
+	if (next != free_ranges.begin()) {
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= first && "freed range overlaps a free range");
+		if (prev->first + prev->second == first) {
+			prev->second += count;
+			return;
+		}
+	}
+
+	free_ranges.emplace_hint(next, first, count);
+}
+
+GLuint VertexArena::buffer(uint32_t block) {
+	std::lock_guard< std::mutex > lock(mutex);
+
+	Block &b = blocks.at(block);
+	if (b.buffer == 0) {
+		//n.b. filled through GL_ARRAY_BUFFER (even for indices) so as not to disturb whatever vertex array is bound:
+		glGenBuffers(1, &b.buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, b.buffer);
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(size_t(b.units) * unit_size), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return b.buffer;
+}
+
+VertexArena &VertexArena::vertices(size_t vertex_size) {
+	static std::mutex arenas_mutex;
+	static std::unordered_map< size_t, std::unique_ptr< VertexArena > > arenas;
+
+	std::lock_guard< std::mutex > lock(arenas_mutex);
+	auto &arena = arenas[vertex_size];
+	if (!arena) arena = std::make_unique< VertexArena >(vertex_size);
+	return *arena;
+}
+
+VertexArena &VertexArena::elements() {
+	static VertexArena arena(sizeof(uint32_t));
+	return arena;
+}
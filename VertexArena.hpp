@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ * A VertexArena sub-allocates ranges of fixed-size units (vertices of one
+ *  layout, or 32-bit indices) out of a few large OpenGL buffers ("blocks"),
+ *  so that many MeshBuffers share the same buffers -- and, through the
+ *  vertex array cache (see MeshBuffer::make_vao), the same vertex arrays.
+ *
+ * Each block keeps a free list of unit ranges (ordered by position, first
+ *  fit, merged with their neighbors when freed). Allocations that don't
+ *  fit in any block get a new block (of BlockBytes, or bigger if the
+ *  allocation is).
+ *
+ * allocate() and free() only do bookkeeping, so can be called from any
+ *  thread (e.g., by a MeshBuffer loading on a worker thread); buffer()
+ *  makes the block's OpenGL buffer the first time it is asked for, so
+ *  must be called from the thread that owns the GL context.
+ *
+ * Blocks are never deleted (freed ranges are reused by later allocations),
+ *  so vertex arrays that refer to their buffers stay valid.
+ *
+ */
+
+#include "GL.hpp"
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct VertexArena {
+	//ranges are counted in units of 'unit_size' bytes:
+	VertexArena(size_t unit_size);
+
+	//arenas are shared, so copying is not allowed:
+	VertexArena(VertexArena const &) = delete;
+	VertexArena &operator=(VertexArena const &) = delete;
+
+	//a range of 'count' units starting at unit 'first' of block 'block':
+	struct Allocation {
+		uint32_t block = -1U; //(-1U if nothing is allocated)
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	//reserve a range of 'count' units (no OpenGL calls):
+	// (empty ranges are placed in block zero, so still have a buffer to point at)
+	// note: will throw if 'count' units would need more than 4GB of buffer
+	Allocation allocate(uint32_t count);
+
+	//return a range from allocate() to the free list (no OpenGL calls):
+	// n.b. draws already submitted may still read the range; uploads into it must not be unsynchronized
+	void free(Allocation const &allocation);
+
+	//the OpenGL buffer holding 'block' (made, with undefined contents, on first call):
+	GLuint buffer(uint32_t block);
+
+	//blocks are (at least) this big:
+	static constexpr size_t BlockBytes = 32 << 20;
+
+	//shared arenas for vertices 'vertex_size' bytes long, and for 32-bit indices:
+	static VertexArena &vertices(size_t vertex_size);
+	static VertexArena &elements();
+
+	//--- internals ---
+	size_t unit_size;
+
+	struct Block {
+		GLuint buffer = 0; //(0 until buffer() is called)
+		uint32_t units = 0;
+		std::map< uint32_t, uint32_t > free_ranges; //first unit -> unit count
+	};
+	std::vector< Block > blocks;
+
+	//guards 'blocks':
+	std::mutex mutex;
+};
@@ -0,0 +1,610 @@
+//cook-meshes converts the flat triangle lists written by export-meshes.py into indexed meshes:
+// vertices that are exactly equal within a mesh are stored once, and each mesh's triangles
+// become indices into them. MeshBuffer (see Mesh.hpp) loads either kind of file.
+//
+//Each mesh is then optimized for drawing:
+// - triangles are reordered for the post-transform vertex cache ("Tipsify", Sander et al. 2007);
+// - the clusters that reordering produces are sorted so that triangles likely to occlude
+//   others (those facing outward, away from the mesh's center) are drawn first, reducing overdraw;
+// - vertices are renumbered in order of first use, so vertex fetches walk through memory.
+// The average cache miss ratio (ACMR: misses per triangle) and average transform to vertex
+// ratio (ATVR: misses per vertex; 1.0 is ideal) of a simulated FIFO cache are reported
+// for each mesh before and after.
+//
+//Each mesh's bounding box and bounding sphere are stored in the index (so MeshBuffer
+// doesn't have to compute them from the vertices when loading).
+//
+//Finally, vertices are quantized (unless --float is given) from 36 to 20 bytes:
+// - positions to 16-bit unsigned normalized values over the mesh's bounding box;
+// - normals to signed normalized 10:10:10:2 (for OpenGL 3.3's conversion, f = (2c + 1) / 1023);
+// - texture coordinates to half floats.
+// (see MeshBuffer::QuantizedVertex for the layout)
+//
+//Usage:
+// cook-meshes [--float] <in.pnct> <out.pnct>
+// (in.pnct may also be a cooked, unquantized file, which is re-optimized)
+//
+//Cooked file format:
+// pnct < Vertex > * [unique vertices; each mesh's vertices are contiguous]
+//  -or- pncq < QuantizedVertex > * [same, quantized]
+// el32 < uint32 > * [indices; absolute, i.e., already offset to the mesh's vertices]
+// str0 < char > * [strings chunk]
+// idx3 < uint32 x6, float x10 > * [name begin/end, vertex begin/end, element begin/end,
+//                                    bounding box min/max (which quantized positions are relative to),
+//                                    bounding sphere center/radius]
+//(files from older versions used 'idx1' -- just the six uint32s -- or 'idx2' -- without the sphere)
+
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+//n.b. vertices are compared as raw bytes, so cooking doesn't need to know their layout beyond the size:
+struct Vertex {
+	uint8_t bytes[3*4+3*4+4*1+2*4];
+};
+static_assert(sizeof(Vertex) == 36, "Vertex matches the pnct layout.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct CookedEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+	uint32_t element_begin, element_end;
+};
+static_assert(sizeof(CookedEntry) == 24, "Cooked index entry should be packed");
+
+//n.b. matches MeshBuffer::QuantizedVertex:
+struct QuantizedVertex {
+	uint16_t position[3];
+	uint16_t padding;
+	uint32_t normal;
+	uint8_t color[4];
+	uint16_t tex_coord[2];
+};
+static_assert(sizeof(QuantizedVertex) == 20, "QuantizedVertex matches the pncq layout.");
+
+struct BoundedEntry {
+	CookedEntry cooked;
+	float min[3], max[3];
+	float sphere_center[3], sphere_radius;
+};
+static_assert(sizeof(BoundedEntry) == 64, "Bounded index entry should be packed");
+
+//size of the simulated post-transform cache (and the cache size Tipsify optimizes for):
+constexpr uint32_t CacheSize = 16;
+
+struct Float3 {
+	float x, y, z;
+};
+
+//position (the first attribute) of a vertex:
+static Float3 position(Vertex const &v) {
+	Float3 ret;
+	std::memcpy(&ret, v.bytes, sizeof(ret));
+	return ret;
+}
+
+//count the misses of a FIFO cache of CacheSize vertices when drawing 'indices':
+static uint32_t cache_misses(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+	std::vector< uint32_t > entered(vertex_count, 0); //time (miss count) at which each vertex entered the cache, plus one
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		//a vertex is still cached if fewer than CacheSize misses happened since it entered:
+		if (entered[i] == 0 || misses - entered[i] >= CacheSize) {
+			misses += 1;
+			entered[i] = misses;
+		}
+	}
+	return misses;
+}
+
+//reorder triangles for the vertex cache with Tipsify:
+// 'indices' index [0, vertex_count); returns the reordered indices,
+// and stores in 'cluster_starts' the (triangle) positions where the cache was effectively flushed.
+static std::vector< uint32_t > tipsify(std::vector< uint32_t > const &indices, uint32_t vertex_count, std::vector< uint32_t > *cluster_starts) {
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//triangles using each vertex:
+	std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+	for (uint32_t i : indices) adjacency_begin[i + 1] += 1;
+	for (uint32_t v = 0; v < vertex_count; ++v) adjacency_begin[v + 1] += adjacency_begin[v];
+	std::vector< uint32_t > adjacency(indices.size());
+	{
+		std::vector< uint32_t > at(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); ++i) {
+			adjacency[at[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector< uint32_t > live(vertex_count); //triangles not yet emitted using each vertex
+	for (uint32_t v = 0; v < vertex_count; ++v) live[v] = adjacency_begin[v + 1] - adjacency_begin[v];
+	std::vector< uint32_t > cached_at(vertex_count, 0); //time each vertex (last) entered the cache
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< uint32_t > dead_end; //recently used vertices, to resume from when a fan runs out
+	uint32_t time = CacheSize + 1;
+	uint32_t cursor = 0; //next vertex to try when the dead-end stack is empty
+
+	std::vector< uint32_t > ret;
+	ret.reserve(indices.size());
+	cluster_starts->clear();
+
+	//a vertex with live triangles to restart from (after a cache flush):
+	auto skip_dead_end = [&]() -> uint32_t {
+		while (!dead_end.empty()) {
+			uint32_t d = dead_end.back();
+			dead_end.pop_back();
+			if (live[d] > 0) return d;
+		}
+		while (cursor < vertex_count) {
+			if (live[cursor] > 0) return cursor;
+			++cursor;
+		}
+		return -1U;
+	};
+
+	uint32_t fan = (vertex_count > 0 ? skip_dead_end() : -1U);
+	if (fan != -1U) cluster_starts->emplace_back(0);
+	std::vector< uint32_t > candidates;
+	while (fan != -1U) {
+		//emit every remaining triangle around 'fan':
+		candidates.clear();
+		for (uint32_t a = adjacency_begin[fan]; a < adjacency_begin[fan + 1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3 * t + c];
+				ret.emplace_back(v);
+				dead_end.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - cached_at[v] > CacheSize) {
+					cached_at[v] = time;
+					time += 1;
+				}
+			}
+		}
+
+		//next fan: the candidate that has been in the cache longest while still surviving its own fan:
+		uint32_t best = -1U;
+		int32_t best_priority = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			int32_t priority = 0;
+			if (time - cached_at[v] + 2 * live[v] <= CacheSize) priority = int32_t(time - cached_at[v]);
+			if (priority > best_priority) {
+				best_priority = priority;
+				best = v;
+			}
+		}
+		if (best == -1U) {
+			best = skip_dead_end();
+			if (best != -1U) cluster_starts->emplace_back(uint32_t(ret.size() / 3));
+		}
+		fan = best;
+	}
+	assert(ret.size() == indices.size());
+	return ret;
+}
+
+//sort clusters (runs of triangles starting at 'cluster_starts') so that those likely to occlude others come first:
+// (the "occlusion potential" of a cluster is how far its centroid lies in front of the mesh's centroid, along its normal)
+static std::vector< uint32_t > sort_clusters(std::vector< uint32_t > const &indices, std::vector< uint32_t > const &cluster_starts, std::vector< Vertex > const &vertices) {
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//area-weighted centroid of the mesh:
+	auto triangle = [&](uint32_t t, Float3 *centroid, Float3 *normal) {
+		Float3 a = position(vertices[indices[3*t+0]]);
+		Float3 b = position(vertices[indices[3*t+1]]);
+		Float3 c = position(vertices[indices[3*t+2]]);
+		Float3 ab{b.x - a.x, b.y - a.y, b.z - a.z};
+		Float3 ac{c.x - a.x, c.y - a.y, c.z - a.z};
+		//(cross product; length is twice the area)
+		*normal = Float3{ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x};
+		*centroid = Float3{(a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f};
+	};
+	Float3 mesh_centroid{0.0f, 0.0f, 0.0f};
+	float mesh_area = 0.0f;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		Float3 centroid, normal;
+		triangle(t, &centroid, &normal);
+		float area = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		mesh_centroid.x += centroid.x * area;
+		mesh_centroid.y += centroid.y * area;
+		mesh_centroid.z += centroid.z * area;
+		mesh_area += area;
+	}
+	if (mesh_area > 0.0f) {
+		mesh_centroid.x /= mesh_area;
+		mesh_centroid.y /= mesh_area;
+		mesh_centroid.z /= mesh_area;
+	}
+
+	struct Cluster {
+		uint32_t begin, end; //triangles
+		float potential;
+	};
+	std::vector< Cluster > clusters;
+	for (uint32_t i = 0; i < cluster_starts.size(); ++i) {
+		Cluster cluster;
+		cluster.begin = cluster_starts[i];
+		cluster.end = (i + 1 < cluster_starts.size() ? cluster_starts[i + 1] : triangle_count);
+
+		Float3 centroid{0.0f, 0.0f, 0.0f};
+		Float3 normal{0.0f, 0.0f, 0.0f};
+		float area = 0.0f;
+		for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+			Float3 tc, tn;
+			triangle(t, &tc, &tn);
+			float ta = std::sqrt(tn.x * tn.x + tn.y * tn.y + tn.z * tn.z);
+			centroid.x += tc.x * ta; centroid.y += tc.y * ta; centroid.z += tc.z * ta;
+			normal.x += tn.x; normal.y += tn.y; normal.z += tn.z;
+			area += ta;
+		}
+		if (area > 0.0f) {
+			centroid.x /= area; centroid.y /= area; centroid.z /= area;
+		}
+		float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		cluster.potential = 0.0f;
+		if (length > 0.0f) {
+			cluster.potential = ((centroid.x - mesh_centroid.x) * normal.x
+				+ (centroid.y - mesh_centroid.y) * normal.y
+				+ (centroid.z - mesh_centroid.z) * normal.z) / length;
+		}
+		clusters.emplace_back(cluster);
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const &a, Cluster const &b) {
+		return a.potential > b.potential;
+	});
+
+	std::vector< uint32_t > ret;
+	ret.reserve(indices.size());
+	for (auto const &cluster : clusters) {
+		ret.insert(ret.end(), indices.begin() + 3 * cluster.begin, indices.begin() + 3 * cluster.end);
+	}
+	return ret;
+}
+
+//optimize one mesh's triangles ('indices', which index 'vertices') in place; prints statistics:
+static void optimize(std::string const &name, std::vector< Vertex > *vertices_, std::vector< uint32_t > *indices_) {
+	auto &vertices = *vertices_;
+	auto &indices = *indices_;
+	uint32_t vertex_count = uint32_t(vertices.size());
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+	if (triangle_count == 0 || indices.size() % 3 != 0) return;
+
+	uint32_t misses_before = cache_misses(indices, vertex_count);
+
+	std::vector< uint32_t > cluster_starts;
+	indices = tipsify(indices, vertex_count, &cluster_starts);
+	indices = sort_clusters(indices, cluster_starts, vertices);
+
+	//renumber vertices in order of first use:
+	std::vector< uint32_t > renumber(vertex_count, -1U);
+	std::vector< Vertex > reordered;
+	reordered.reserve(vertex_count);
+	for (uint32_t &i : indices) {
+		if (renumber[i] == -1U) {
+			renumber[i] = uint32_t(reordered.size());
+			reordered.emplace_back(vertices[i]);
+		}
+		i = renumber[i];
+	}
+	//(keep any unused vertices, so the vertex count doesn't change)
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		if (renumber[v] == -1U) reordered.emplace_back(vertices[v]);
+	}
+	vertices = std::move(reordered);
+
+	uint32_t misses_after = cache_misses(indices, vertex_count);
+
+	std::cout << "  " << name << ": " << triangle_count << " triangles, " << vertex_count << " vertices, "
+		<< cluster_starts.size() << " clusters; ACMR " << float(misses_before) / triangle_count << " -> " << float(misses_after) / triangle_count
+		<< ", ATVR " << float(misses_before) / vertex_count << " -> " << float(misses_after) / vertex_count << std::endl;
+}
+
+//round-to-nearest-even conversion to half-float bits (overflow goes to infinity):
+static uint16_t float_to_half(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+	uint32_t abs = bits & 0x7fffffff;
+	if (abs >= 0x7f800000) {
+		//infinity or nan:
+		return uint16_t(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+	}
+	if (abs >= 0x477ff000) {
+		//rounds past the largest half (65504):
+		return uint16_t(sign | 0x7c00);
+	}
+	if (abs < 0x38800000) {
+		//subnormal half (or zero); value is abs_float * 2^24 in units of the last place:
+		float abs_f;
+		std::memcpy(&abs_f, &abs, sizeof(abs_f));
+		return uint16_t(sign | uint16_t(std::nearbyint(abs_f * 16777216.0f)));
+	}
+	//normal half: rebias exponent, then round the 13 dropped mantissa bits:
+	uint32_t h = ((abs - 0x38000000) >> 13);
+	uint32_t rest = abs & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) ++h;
+	return uint16_t(sign | h);
+}
+
+//the fields of a Vertex:
+struct Unpacked {
+	float position[3];
+	float normal[3];
+	uint8_t color[4];
+	float tex_coord[2];
+};
+static_assert(sizeof(Unpacked) == sizeof(Vertex), "Unpacked matches the pnct layout.");
+
+//compute the bounding box and bounding sphere of one mesh's vertices:
+static void bound(std::vector< Vertex > const &vertices, CookedEntry const &entry, BoundedEntry *bounded_) {
+	assert(bounded_);
+	auto &bounded = *bounded_;
+
+	bounded.cooked = entry;
+	for (uint32_t c = 0; c < 3; ++c) {
+		bounded.min[c] = bounded.max[c] = bounded.sphere_center[c] = 0.0f;
+	}
+	bounded.sphere_radius = -1.0f;
+	if (entry.vertex_begin == entry.vertex_end) return;
+
+	std::vector< std::array< double, 3 > > points;
+	points.reserve(entry.vertex_end - entry.vertex_begin);
+	for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+		Unpacked u;
+		std::memcpy(&u, &vertices[v], sizeof(u));
+		points.push_back({{ u.position[0], u.position[1], u.position[2] }});
+		for (uint32_t c = 0; c < 3; ++c) {
+			bounded.min[c] = (v == entry.vertex_begin ? u.position[c] : std::min(bounded.min[c], u.position[c]));
+			bounded.max[c] = (v == entry.vertex_begin ? u.position[c] : std::max(bounded.max[c], u.position[c]));
+		}
+	}
+
+	auto distance = [](std::array< double, 3 > const &a, std::array< double, 3 > const &b) {
+		return std::sqrt((a[0]-b[0])*(a[0]-b[0]) + (a[1]-b[1])*(a[1]-b[1]) + (a[2]-b[2])*(a[2]-b[2]));
+	};
+	auto farthest = [&](std::array< double, 3 > const &from) {
+		std::array< double, 3 > const *ret = &points[0];
+		for (auto const &p : points) {
+			if (distance(p, from) > distance(*ret, from)) ret = &p;
+		}
+		return *ret;
+	};
+	//radius needed to cover every point from 'center':
+	auto radius_from = [&](std::array< double, 3 > const &center) {
+		double r = 0.0;
+		for (auto const &p : points) r = std::max(r, distance(p, center));
+		return r;
+	};
+
+	//Ritter's sphere: start from a pair of far-apart points, then grow to cover any points outside:
+	std::array< double, 3 > y = farthest(points[0]);
+	std::array< double, 3 > z = farthest(y);
+	std::array< double, 3 > center{{ 0.5 * (y[0] + z[0]), 0.5 * (y[1] + z[1]), 0.5 * (y[2] + z[2]) }};
+	double radius = 0.5 * distance(y, z);
+	for (auto const &p : points) {
+		double d = distance(p, center);
+		if (d <= radius) continue;
+		double grown = 0.5 * (radius + d);
+		for (uint32_t c = 0; c < 3; ++c) center[c] += (d - grown) / d * (p[c] - center[c]);
+		radius = grown;
+	}
+
+	//...which is usually, but not always, tighter than the sphere around the box's center:
+	std::array< double, 3 > box_center{{ 0.5 * (double(bounded.min[0]) + bounded.max[0]), 0.5 * (double(bounded.min[1]) + bounded.max[1]), 0.5 * (double(bounded.min[2]) + bounded.max[2]) }};
+	if (radius_from(box_center) < radius) center = box_center;
+
+	//store the radius that covers every point from the center as rounded to float:
+	for (uint32_t c = 0; c < 3; ++c) {
+		bounded.sphere_center[c] = float(center[c]);
+		center[c] = bounded.sphere_center[c];
+	}
+	bounded.sphere_radius = std::nextafter(float(radius_from(center)), std::numeric_limits< float >::infinity());
+}
+
+//quantize the vertices of one mesh over its bounding box:
+static void quantize(std::vector< Vertex > const &vertices, BoundedEntry const &bounded, std::vector< QuantizedVertex > *quantized_) {
+	assert(quantized_);
+	auto &quantized = *quantized_;
+	CookedEntry const &entry = bounded.cooked;
+
+	for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+		Unpacked u;
+		std::memcpy(&u, &vertices[v], sizeof(u));
+		QuantizedVertex q;
+		for (uint32_t c = 0; c < 3; ++c) {
+			float extent = bounded.max[c] - bounded.min[c];
+			float t = (extent > 0.0f ? (u.position[c] - bounded.min[c]) / extent : 0.0f);
+			q.position[c] = uint16_t(std::round(std::max(0.0f, std::min(1.0f, t)) * 65535.0f));
+		}
+		q.padding = 0;
+		q.normal = 0;
+		for (uint32_t c = 0; c < 3; ++c) {
+			//invert OpenGL 3.3's signed normalized conversion, f = (2c + 1) / 1023:
+			// (later versions use max(c / 511, -1), which these values are also within half a step of)
+			float f = std::max(-1.0f, std::min(1.0f, u.normal[c]));
+			int32_t n = int32_t(std::round((f * 1023.0f - 1.0f) * 0.5f));
+			n = std::max(-512, std::min(511, n));
+			q.normal |= (uint32_t(n) & 0x3ff) << (10 * c);
+		}
+		std::memcpy(q.color, u.color, sizeof(q.color));
+		q.tex_coord[0] = float_to_half(u.tex_coord[0]);
+		q.tex_coord[1] = float_to_half(u.tex_coord[1]);
+		quantized.emplace_back(q);
+	}
+}
+
+int main(int argc, char **argv) {
+	bool keep_float = (argc == 4 && std::string(argv[1]) == "--float");
+	if (argc != 3 && !keep_float) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--float] <in.pnct> <out.pnct>\nStores the vertices of each mesh in in.pnct once (quantized, unless --float is given), and draws them by index." << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[argc-2];
+	std::string out_filename = argv[argc-1];
+
+	try {
+		std::vector< Vertex > vertices;
+		std::vector< char > strings;
+		std::vector< IndexEntry > index;
+		{
+			std::ifstream file(in_filename, std::ios::binary);
+			if (!file) throw std::runtime_error("Failed to open '" + in_filename + "'.");
+			{ //quantization loses precision, so quantized files can't be cooked again:
+				char magic[4];
+				if (file.read(magic, 4) && std::string(magic, 4) == "pncq") {
+					throw std::runtime_error("'" + in_filename + "' is already quantized; cook from the exported file instead.");
+				}
+				file.clear();
+				file.seekg(0);
+			}
+			read_chunk(file, "pnct", &vertices);
+
+			//already-cooked files are expanded back to triangle lists (so cooking again just re-optimizes):
+			std::streampos at = file.tellg();
+			char magic[4];
+			bool cooked = (file.read(magic, 4) && std::string(magic, 4) == "el32");
+			file.clear();
+			file.seekg(at);
+			if (cooked) {
+				std::vector< uint32_t > cooked_elements;
+				read_chunk(file, "el32", &cooked_elements);
+				read_chunk(file, "str0", &strings);
+				//(only the first six fields of the index matter here; bounds are recomputed)
+				std::vector< uint32_t > index_fields;
+				at = file.tellg();
+				bool bounded = (file.read(magic, 4) && std::string(magic, 4) == "idx3");
+				file.clear();
+				file.seekg(at);
+				read_chunk(file, bounded ? "idx3" : "idx1", &index_fields);
+				size_t stride = (bounded ? sizeof(BoundedEntry) : sizeof(CookedEntry)) / sizeof(uint32_t);
+				if (index_fields.size() % stride != 0) throw std::runtime_error("index chunk size not divisible by entry size");
+				std::vector< CookedEntry > cooked_index(index_fields.size() / stride);
+				for (size_t i = 0; i < cooked_index.size(); ++i) {
+					std::memcpy(&cooked_index[i], &index_fields[i * stride], sizeof(CookedEntry));
+				}
+				std::vector< Vertex > flat;
+				for (auto const &entry : cooked_index) {
+					if (!(entry.element_begin <= entry.element_end && entry.element_end <= cooked_elements.size())) {
+						throw std::runtime_error("index entry has out-of-range element start/count");
+					}
+					IndexEntry expanded;
+					expanded.name_begin = entry.name_begin;
+					expanded.name_end = entry.name_end;
+					expanded.vertex_begin = uint32_t(flat.size());
+					for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+						if (cooked_elements[e] >= vertices.size()) throw std::runtime_error("element out of range");
+						flat.emplace_back(vertices[cooked_elements[e]]);
+					}
+					expanded.vertex_end = uint32_t(flat.size());
+					index.emplace_back(expanded);
+				}
+				vertices = std::move(flat);
+			} else {
+				read_chunk(file, "str0", &strings);
+				read_chunk(file, "idx0", &index);
+			}
+		}
+
+		std::cout << "Optimizing for a " << CacheSize << "-entry vertex cache:" << std::endl;
+		std::vector< Vertex > cooked_vertices;
+		std::vector< uint32_t > elements;
+		std::vector< CookedEntry > cooked_index;
+		cooked_vertices.reserve(vertices.size());
+		elements.reserve(vertices.size());
+
+		for (auto const &entry : index) {
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			CookedEntry cooked;
+			cooked.name_begin = entry.name_begin;
+			cooked.name_end = entry.name_end;
+			cooked.vertex_begin = uint32_t(cooked_vertices.size());
+			cooked.element_begin = uint32_t(elements.size());
+
+			//n.b. deduplicating only within each mesh keeps every mesh's vertices contiguous:
+			std::vector< Vertex > mesh_vertices;
+			std::vector< uint32_t > mesh_indices; //(relative to the mesh's first vertex)
+			std::unordered_map< std::string, uint32_t > seen;
+			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+				std::string key(reinterpret_cast< char const * >(vertices[v].bytes), sizeof(Vertex));
+				auto f = seen.emplace(key, uint32_t(mesh_vertices.size()));
+				if (f.second) mesh_vertices.emplace_back(vertices[v]);
+				mesh_indices.emplace_back(f.first->second);
+			}
+
+			optimize(std::string(strings.data() + entry.name_begin, strings.data() + entry.name_end), &mesh_vertices, &mesh_indices);
+
+			for (uint32_t i : mesh_indices) {
+				elements.emplace_back(cooked.vertex_begin + i);
+			}
+			cooked_vertices.insert(cooked_vertices.end(), mesh_vertices.begin(), mesh_vertices.end());
+
+			cooked.vertex_end = uint32_t(cooked_vertices.size());
+			cooked.element_end = uint32_t(elements.size());
+			cooked_index.emplace_back(cooked);
+		}
+
+		std::vector< BoundedEntry > bounded_index(cooked_index.size());
+		for (size_t i = 0; i < cooked_index.size(); ++i) {
+			bound(cooked_vertices, cooked_index[i], &bounded_index[i]);
+		}
+
+		std::ofstream file(out_filename, std::ios::binary);
+		size_t vertex_size = sizeof(Vertex);
+		if (keep_float) {
+			write_chunk("pnct", cooked_vertices, &file);
+			write_chunk("el32", elements, &file);
+			write_chunk("str0", strings, &file);
+			write_chunk("idx3", bounded_index, &file);
+		} else {
+			std::vector< QuantizedVertex > quantized_vertices;
+			quantized_vertices.reserve(cooked_vertices.size());
+			for (auto const &bounded : bounded_index) {
+				quantize(cooked_vertices, bounded, &quantized_vertices);
+			}
+			write_chunk("pncq", quantized_vertices, &file);
+			write_chunk("el32", elements, &file);
+			write_chunk("str0", strings, &file);
+			write_chunk("idx3", bounded_index, &file);
+			vertex_size = sizeof(QuantizedVertex);
+		}
+		if (!file) throw std::runtime_error("Failed to write '" + out_filename + "'.");
+
+		size_t before = vertices.size() * sizeof(Vertex);
+		size_t after = cooked_vertices.size() * vertex_size + elements.size() * sizeof(uint32_t);
+		std::cout << "Cooked " << index.size() << " meshes: " << vertices.size() << " vertices -> "
+			<< cooked_vertices.size() << " vertices + " << elements.size() << " indices ("
+			<< before << " -> " << after << " bytes)." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -16,6 +16,9 @@
 //for screenshots:
 #include "load_save_png.hpp"
 
+//for per-frame rendering counters:
+#include "RenderStats.hpp"
+
 //Includes for libSDL:
 #include <SDL.h>
 
@@ -183,7 +186,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			render_stats.next_frame();
 			Mode::current->draw(drawable_size);
 		}
 
@@ -4,6 +4,9 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -41,6 +44,73 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 }
 
 
+//a chunk's elements, read in place from memory (e.g., a MappedFile):
+template< typename T >
+struct ChunkView {
+	T const *elements = nullptr;
+	size_t count = 0;
+
+	//(container-like interface, so code can use a ChunkView much like a std::vector):
+	T const *data() const { return elements; }
+	size_t size() const { return count; }
+	T const *begin() const { return elements; }
+	T const *end() const { return elements + count; }
+	T const &operator[](size_t i) const { assert(i < count); return elements[i]; }
+
+	//if the chunk's data isn't suitably aligned for T, it is copied here instead:
+	std::vector< T > unaligned_copy;
+
+	ChunkView() = default;
+	//'elements' may point into 'unaligned_copy', so copying is not allowed:
+	ChunkView(ChunkView const &) = delete;
+	ChunkView &operator=(ChunkView const &) = delete;
+};
+
+//helper function that reads a chunk (in the same format as above) from the memory range [*at_, end):
+// advances *at_ past the chunk; the chunk data is validated but not copied (unless misaligned)
+template< typename T >
+void read_chunk(char const **at_, char const *end, std::string const &magic, ChunkView< T > *to_) {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk elements are read directly from memory");
+	assert(at_);
+	assert(to_);
+	char const *&at = *at_;
+	auto &to = *to_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, at, sizeof(header));
+	at += sizeof(header);
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - at) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	to.count = header.size / sizeof(T);
+	if (reinterpret_cast< uintptr_t >(at) % alignof(T) == 0) {
+		to.unaligned_copy.clear();
+		to.elements = reinterpret_cast< T const * >(at);
+	} else {
+		to.unaligned_copy.resize(to.count);
+		if (to.count) std::memcpy(to.unaligned_copy.data(), at, header.size);
+		to.elements = to.unaligned_copy.data();
+	}
+	at += header.size;
+}
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
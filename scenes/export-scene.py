@@ -65,11 +65,17 @@ camera_data = b""
 lamp_data = b""
 
 #write_string will add a string to the strings section and return a packed (begin,end) reference:
+#strings already in strings_data, so repeated names (e.g., meshes used by several objects) are stored once:
+string_ranges = dict()
+
 def write_string(string):
 	global strings_data
-	begin = len(strings_data)
-	strings_data += bytes(string, 'utf8')
-	end = len(strings_data)
+	if string not in string_ranges:
+		begin = len(strings_data)
+		strings_data += bytes(string, 'utf8')
+		end = len(strings_data)
+		string_ranges[string] = (begin, end)
+	begin, end = string_ranges[string]
 	return struct.pack('II', begin, end)
 
 
@@ -220,6 +226,11 @@ def write_chunk(magic, data):
 	blob.write(struct.pack('I', len(data))) #length
 	blob.write(data)
 
+#pad the strings chunk to a multiple of four bytes so the following chunks stay aligned
+# (the loader reads chunks in place from a memory-mapped file; names are referenced by (begin,end), so padding is never read):
+while len(strings_data) % 4 != 0:
+	strings_data += b'\0'
+
 write_chunk(b'str0', strings_data)
 write_chunk(b'xfh0', xfh_data)
 write_chunk(b'msh0', mesh_data)
@@ -228,3 +239,100 @@ write_chunk(b'lmp0', lamp_data)
 
 print("Wrote " + str(blob.tell()) + " bytes to '" + outfile + "'")
 blob.close()
+
+#---------------------------------------------------------------------
+#Export animation (if any objects are animated):
+
+#Animation file format (see Animation.hpp):
+# str0 len < char > * [strings chunk]
+# tim0 len < float > * [key times; shared by tracks]
+# trk0 len < uint uint uint uint uint uint > * [name begin/end, channel (0: position, 1: rotation), times begin/end, values begin]
+# pos0 len < float3 > * [position keys]
+# rot0 len < uint16 x3 > * [quantized rotation keys]
+
+#animated objects (not visited through instanced collections, since those would share names):
+animated = []
+for par_obj in obj_to_xfh:
+	if len(par_obj) != 1: continue
+	obj = par_obj[0]
+	if obj.animation_data and obj.animation_data.action:
+		animated.append(obj)
+
+#quantize a quaternion with the "smallest three" encoding used by Animation::QuantizedQuat:
+def quantize_quat(q):
+	c = [q.x, q.y, q.z, q.w]
+	length = math.sqrt(sum(x*x for x in c))
+	c = [x / length for x in c]
+	largest = max(range(4), key=lambda i: abs(c[i]))
+	sign = -1.0 if c[largest] < 0.0 else 1.0
+	Range = 1.0 / math.sqrt(2.0)
+	v = []
+	for i in range(4):
+		if i == largest: continue
+		u = min(1.0, max(0.0, (sign * c[i] / Range) * 0.5 + 0.5))
+		v.append(int(round(u * 32767.0)))
+	v[0] |= (largest & 1) << 15
+	v[1] |= (largest >> 1) << 15
+	return struct.pack('3H', *v)
+
+if len(animated) > 0:
+	scene = bpy.context.scene
+	frames = list(range(scene.frame_start, scene.frame_end + 1))
+	fps = scene.render.fps / scene.render.fps_base
+
+	#sample local transforms (as in write_xfh) at every frame:
+	samples = { obj : [] for obj in animated }
+	for frame in frames:
+		scene.frame_set(frame)
+		for obj in animated:
+			if obj.parent == None:
+				world_to_parent = mathutils.Matrix()
+			else:
+				world_to_parent = obj.parent.matrix_world.copy()
+				world_to_parent.invert()
+			samples[obj].append((world_to_parent @ obj.matrix_world).decompose())
+
+	#every track shares one timeline:
+	anim_strings_data = b""
+	times_data = b""
+	for frame in frames:
+		times_data += struct.pack('f', (frame - scene.frame_start) / fps)
+	track_data = b""
+	position_data = b""
+	rotation_data = b""
+	position_count = 0
+	rotation_count = 0
+
+	#only write channels that actually change:
+	Epsilon = 1e-5
+	for obj in animated:
+		name_begin = len(anim_strings_data)
+		anim_strings_data += bytes(obj.name, 'utf8')
+		name_end = len(anim_strings_data)
+		positions = [ s[0] for s in samples[obj] ]
+		rotations = [ s[1] for s in samples[obj] ]
+		if any((p - positions[0]).length > Epsilon for p in positions):
+			track_data += struct.pack('6I', name_begin, name_end, 0, 0, len(frames), position_count)
+			for p in positions:
+				position_data += struct.pack('3f', p.x, p.y, p.z)
+			position_count += len(positions)
+			print("animation: " + obj.name + " position")
+		if any(abs(abs(r.dot(rotations[0])) - 1.0) > Epsilon for r in rotations):
+			track_data += struct.pack('6I', name_begin, name_end, 1, 0, len(frames), rotation_count)
+			for r in rotations:
+				rotation_data += quantize_quat(r)
+			rotation_count += len(rotations)
+			print("animation: " + obj.name + " rotation")
+
+	while len(anim_strings_data) % 4 != 0:
+		anim_strings_data += b'\0'
+
+	animfile = re.sub(r'\.scene$', '', outfile) + '.anim'
+	blob = open(animfile, 'wb')
+	write_chunk(b'str0', anim_strings_data)
+	write_chunk(b'tim0', times_data)
+	write_chunk(b'trk0', track_data)
+	write_chunk(b'pos0', position_data)
+	write_chunk(b'rot0', rotation_data)
+	print("Wrote " + str(blob.tell()) + " bytes to '" + animfile + "'")
+	blob.close()
@@ -3,6 +3,7 @@
 #include "Load.hpp"
 #include "GL.hpp"
 #include "load_save_png.hpp"
+#include "RenderStats.hpp"
 
 #include <SDL.h>
 
@@ -170,7 +171,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			render_stats.next_frame();
 			Mode::current->draw(drawable_size);
 		}
 
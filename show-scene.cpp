@@ -4,6 +4,7 @@
 #include "GL.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
+#include "RenderStats.hpp"
 
 #include <SDL.h>
 
@@ -107,9 +108,13 @@ int main(int argc, char **argv) {
 	if (scene_file != "") {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+			auto resolve = [&buffer](std::vector< std::string_view > const &mesh_names) {
+				if (!buffer) return std::vector< MeshBuffer::Handle >(mesh_names.size(), MeshBuffer::InvalidHandle);
+				return buffer->resolve(mesh_names);
+			};
+			scene->load(scene_file, resolve, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, MeshBuffer::Handle handle){
 				if (!buffer_vao) return;
-				Mesh const &mesh = buffer->lookup(mesh_name);
+				Mesh const &mesh = buffer->get(handle);
 
 				scene.drawables.emplace_back(transform);
 				Scene::Drawable &drawable = scene.drawables.back();
@@ -120,7 +125,17 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.position_scale = mesh.position_scale;
+				drawable.pipeline.position_offset = mesh.position_offset;
 
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
+				drawable.sphere_center = mesh.sphere_center;
+				drawable.sphere_radius = mesh.sphere_radius;
+
+				//used when occlusion culling is on (see ShowSceneMode):
+				drawable.occluder = buffer->lookup_occluder(handle);
 			});
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
@@ -212,7 +227,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			render_stats.next_frame();
 			Mode::current->draw(drawable_size);
 		}
 